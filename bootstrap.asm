@@ -15,9 +15,6 @@ jmp main
 //------------------------------------------------------------------------------		
 	
 read: { :read() rts }
-write: { :write() rts }
-ack: { :ack() rts }
-wait: { :wait() rts }
 
 //------------------------------------------------------------------------------		
 	
@@ -33,9 +30,9 @@ main: {
 
         sei
 
-loop:	jsr wait
+loop:	:wait()
 	ldy $dd01
-	jsr ack   
+	:ack()
 
 	cpy #Command.load 
 	bne loop
@@ -55,10 +52,10 @@ load: {
 	
 	ldy #$00
 	
-!loop:  jsr wait
+!loop:  :wait()   // inlined, this loop receives the whole server
 	lda $dd01 
 	sta (start),y
-	jsr ack
+	:ack()
 	:next()
 
 done:   lda end
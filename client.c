@@ -12,6 +12,7 @@
 #include "target.h"
 #include "client.h"
 #include "range.h"
+#include "disk.h"
 #include "util.h"
 #include "xlink.h"
 #include "machine.h"
@@ -34,11 +35,29 @@
 #define COMMAND_RELOCATE   0x14
 #define COMMAND_KERNAL     0x15
 #define COMMAND_FILL       0x16
+#define COMMAND_HUNT       0x17
+#define COMMAND_COMPARE    0x18
+#define COMMAND_REU        0x19
+#define COMMAND_VDC        0x1a
+#define COMMAND_STUB       0x1b
+#define COMMAND_HANDLER    0x1c
+#define COMMAND_SERVE      0x1d
+#define COMMAND_DEVICES    0x1e
+#define COMMAND_STATS      0x1f
+
+#define MAX_REPORTED       256
+#define SESSION_TIMEOUT    3
+#define REU_SIZE           0x1000000
+#define LINEAR_SIZE        0x20000
+#define VDC_SIZE           0x10000
+#define SERVE_DEVICE       8
+#define LOOPBACK_REQUESTS  1000
 
 #define MODE_EXEC 0x00
 #define MODE_HELP 0x01
 
 int mode  = MODE_EXEC;
+bool keep_screen = false;
 
 static struct option options[] = {
   {"help",    no_argument,       0, 'h'},
@@ -51,6 +70,10 @@ static struct option options[] = {
   {"address", required_argument, 0, 'a'},
   {"skip",    required_argument, 0, 's'},
   {"force",   required_argument, 0, 'f'},
+  {"compress", required_argument, 0, 'z'},
+  {"keep-screen", no_argument,     0, 'k'},
+  {"linear",  no_argument,       0, 'l'},
+  {"loopback", no_argument,      0, 'L'},
   {0, 0, 0, 0}
 };
 
@@ -72,8 +95,17 @@ char str2id(const char* arg) {
   if (strcmp(arg, "identify"  ) == 0) return COMMAND_IDENTIFY;
   if (strcmp(arg, "server"    ) == 0) return COMMAND_SERVER;
   if (strcmp(arg, "relocate"  ) == 0) return COMMAND_RELOCATE;
+  if (strcmp(arg, "stub"      ) == 0) return COMMAND_STUB;
+  if (strcmp(arg, "handler"   ) == 0) return COMMAND_HANDLER;
+  if (strcmp(arg, "serve"     ) == 0) return COMMAND_SERVE;
+  if (strcmp(arg, "devices"   ) == 0) return COMMAND_DEVICES;
+  if (strcmp(arg, "stats"     ) == 0) return COMMAND_STATS;
   if (strcmp(arg, "kernal"    ) == 0) return COMMAND_KERNAL;      
   if (strcmp(arg, "fill"      ) == 0) return COMMAND_FILL;      
+  if (strcmp(arg, "hunt"      ) == 0) return COMMAND_HUNT;      
+  if (strcmp(arg, "compare"   ) == 0) return COMMAND_COMPARE;      
+  if (strcmp(arg, "reu"       ) == 0) return COMMAND_REU;      
+  if (strcmp(arg, "vdc"       ) == 0) return COMMAND_VDC;      
 
   return COMMAND_NONE;
 }
@@ -97,8 +129,17 @@ char* id2str(const char id) {
   if (id == COMMAND_IDENTIFY)   return (char*) "identify";
   if (id == COMMAND_SERVER)     return (char*) "server";
   if (id == COMMAND_RELOCATE)   return (char*) "relocate";
+  if (id == COMMAND_STUB)       return (char*) "stub";
+  if (id == COMMAND_HANDLER)    return (char*) "handler";
+  if (id == COMMAND_SERVE)      return (char*) "serve";
+  if (id == COMMAND_DEVICES)    return (char*) "devices";
+  if (id == COMMAND_STATS)      return (char*) "stats";
   if (id == COMMAND_KERNAL)     return (char*) "kernal";      
   if (id == COMMAND_FILL)       return (char*) "fill";      
+  if (id == COMMAND_HUNT)       return (char*) "hunt";      
+  if (id == COMMAND_COMPARE)    return (char*) "compare";      
+  if (id == COMMAND_REU)        return (char*) "reu";      
+  if (id == COMMAND_VDC)        return (char*) "vdc";      
   return (char*) "unknown";
 }
 
@@ -202,7 +243,41 @@ bool commands_each(Commands* self, bool (*func) (Command* command)) {
 //------------------------------------------------------------------------------
 
 bool commands_execute(Commands* self) {
-  return commands_each(self, &command_execute);
+
+  bool result = true;
+  bool session = false;
+  int batched = 0;
+  
+  for(int i=0; i<self->count; i++) {
+    if(command_batchable(self->items[i])) batched++;
+  }
+  
+  for(int i=0; i<self->count; i++) {
+
+    // run consecutive memory commands in a server session
+    
+    if(batched > 1 && mode == MODE_EXEC) {
+
+      if(command_batchable(self->items[i]) && !session) {
+        logger->suspend();
+        session = xlink_session_begin(false, SESSION_TIMEOUT);
+        logger->resume();
+      }
+      else if(!command_batchable(self->items[i]) && session) {
+        xlink_session_end();
+        session = false;
+      }
+    }
+    
+    if(!(result = command_execute(self->items[i]))) {
+      break;
+    }
+  }
+
+  if(session) {
+    xlink_session_end();
+  }
+  return result;
 }
 
 //------------------------------------------------------------------------------
@@ -236,6 +311,8 @@ Command* command_new(int *argc, char ***argv) {
   command->end       = -1;
   command->skip      = -1;
   command->force     = false;
+  command->linear    = false;
+  command->loopback  = false;
   command->argc      = 0;
   command->argv      = (char**) calloc(1, sizeof(char*));
   
@@ -259,6 +336,23 @@ void command_free(Command* self) {
   free(self);
 }
 
+//------------------------------------------------------------------------------
+
+bool command_batchable(Command* self) {
+
+  switch(self->id) {
+  case COMMAND_LOAD:
+  case COMMAND_SAVE:
+  case COMMAND_POKE:
+  case COMMAND_PEEK:
+  case COMMAND_FILL:
+  case COMMAND_HUNT:
+  case COMMAND_COMPARE:
+    return true;
+  }
+  return false;
+}
+
 //------------------------------------------------------------------------------
 int command_arity(Command* self) {
 
@@ -278,8 +372,17 @@ int command_arity(Command* self) {
   if (self->id == COMMAND_IDENTIFY)   return 0;
   if (self->id == COMMAND_SERVER)     return 1;
   if (self->id == COMMAND_RELOCATE)   return 1;
+  if (self->id == COMMAND_STUB)       return 0;
+  if (self->id == COMMAND_HANDLER)    return 2;
+  if (self->id == COMMAND_SERVE)      return 2;
+  if (self->id == COMMAND_DEVICES)    return 0;
+  if (self->id == COMMAND_STATS)      return 1;
   if (self->id == COMMAND_KERNAL)     return 2;    
   if (self->id == COMMAND_FILL)       return 2;    
+  if (self->id == COMMAND_HUNT)       return 2;    
+  if (self->id == COMMAND_COMPARE)    return 1;    
+  if (self->id == COMMAND_REU)        return 3;    
+  if (self->id == COMMAND_VDC)        return 3;    
   return 0;
 
 }
@@ -310,7 +413,12 @@ void command_consume_arguments(Command *self, int *argc, char ***argv) {
   for(;hasNext;next) {
 
     if(isCommand(current) && !isOptarg(previous, current)) {
-      break;
+
+      // the reu and vdc commands take load, save etc. as their first argument
+      
+      if(!((self->id == COMMAND_REU || self->id == COMMAND_VDC) && consumed == 0)) {
+        break;
+      }
     }
     
     if (consumed == arity && arity > 0) {
@@ -348,6 +456,41 @@ void command_append_argument(Command* self, char* arg) {
 
 //------------------------------------------------------------------------------
 
+static bool command_valid_address(Command* self, int address) {
+  return self->linear ? address >= 0 && address <= LINEAR_SIZE : valid(address);
+}
+
+//------------------------------------------------------------------------------
+
+static bool command_valid_range(Command* self) {
+
+  if (!command_valid_address(self, self->start)) {
+    logger->error("start address out of range: 0x%04X", self->start);
+    return false;
+  }
+
+  if(self->end != -1) {
+        
+    if (!command_valid_address(self, self->end)) {
+      logger->error("end address out of range: 0x%04X", self->end);
+      return false;
+    }
+	
+    if (self->end < self->start) {
+      logger->error("end address before start address: 0x%04X > 0x%04X", self->end, self->start);
+      return false;
+    }
+	
+    if (self->start == self->end) {
+      logger->error("start address equals end address: 0x%04X == 0x%04X", self->end, self->start);
+      return false;	
+    }
+  }
+  return true;
+}
+
+//------------------------------------------------------------------------------
+
 bool command_parse_options(Command *self) {
   
   int option, index;
@@ -357,7 +500,7 @@ bool command_parse_options(Command *self) {
   
   while(1) {
 
-    option = getopt_long(self->argc, self->argv, "hvqfd:M:m:b:a:s:", options, &index);
+    option = getopt_long(self->argc, self->argv, "hvqfklLd:M:m:b:a:s:z:", options, &index);
     
     if(option == -1)
       break;
@@ -410,28 +553,6 @@ bool command_parse_options(Command *self) {
         self->end = strtol(end+1, NULL, 0);
       }
 
-      if (!valid(self->start)) {
-        logger->error("start address out of range: 0x%04X", self->start);
-        return false;
-      }
-
-      if(self->end != -1) {
-        
-        if (!valid(self->end)) {
-          logger->error("end address out of range: 0x%04X", self->end);
-          return false;
-        }
-	
-        if (self->end < self->start) {
-          logger->error("end address before start address: 0x%04X > 0x%04X", self->end, self->start);
-          return false;
-        }
-	
-        if (self->start == self->end) {
-          logger->error("start address equals end address: 0x%04X == 0x%04X", self->end, self->start);
-          return false;	
-        }
-      }
       break;
 
     case 's':
@@ -441,9 +562,45 @@ bool command_parse_options(Command *self) {
     case 'f':
       self->force = true;
       break;
+
+    case 'k':
+      keep_screen = true;
+      break;
+
+    case 'l':
+      self->linear = true;
+      break;
+
+    case 'L':
+      self->loopback = true;
+      break;
+
+    case 'z':
+      if(strcasecmp(optarg, "auto") == 0) {
+        xlink_set_compression(XLINK_COMPRESSION_AUTO);
+      }
+      else if(strcasecmp(optarg, "always") == 0) {
+        xlink_set_compression(XLINK_COMPRESSION_ALWAYS);
+      }
+      else if(strcasecmp(optarg, "never") == 0) {
+        xlink_set_compression(XLINK_COMPRESSION_NONE);
+      }
+      else {
+        logger->error("unknown compression mode: %s", optarg);
+        return false;
+      }
+      break;
     }    
   }
 
+  // REU and VDC addresses are checked by the reu and vdc commands
+  
+  if (self->start != -1 && self->id != COMMAND_REU && self->id != COMMAND_VDC) {
+    if(!command_valid_range(self)) {
+      return false;
+    }
+  }
+  
   self->argc -= optind;
   self->argv += optind;
   self->offset = optind;
@@ -557,11 +714,17 @@ void command_apply_memory_and_bank(Command* self) {
 
   if (self->bank == 0xff)
     self->bank = machine->bank;
+
+  if (keep_screen)
+    self->memory |= 0x80; // leave screen and clock speed untouched
 }
 
 void command_apply_safe_memory_and_bank(Command* self) {
   self->memory = machine->safe_memory;
   self->bank   = machine->safe_bank;
+
+  if (keep_screen)
+    self->memory |= 0x80;
 }
 
 //------------------------------------------------------------------------------
@@ -605,17 +768,16 @@ bool command_none(Command* self) {
 
 //------------------------------------------------------------------------------
 
-bool command_load(Command* self) {
-  
+static long command_read_file(Command* self, unsigned char** data) {
+
   FILE *file;
   struct stat st;
   long size;
   int loadAddress;
-  unsigned char *data;
   
   if (self->argc == 0) {
     logger->error("no file specified");
-    return false;
+    return -1;
   }
 
   char *filename = self->argv[0];
@@ -624,7 +786,7 @@ bool command_load(Command* self) {
   
   if (file == NULL) {
     logger->error("'%s': %s", filename, strerror(errno));
-    return false;
+    return -1;
   }
   stat(filename, &st);
   size = st.st_size;
@@ -651,26 +813,83 @@ bool command_load(Command* self) {
     size = self->end - self->start;
   }
 
+  *data = (unsigned char*) calloc(size, sizeof(unsigned char));
+  
+  fseek(file, self->skip, SEEK_SET);
+  fread(*data, sizeof(unsigned char), size, file);
+  fclose(file);  
+
+  return size;
+}
+
+//------------------------------------------------------------------------------
+
+static bool command_check_linear(Command* self) {
+
+  if(machine->type != XLINK_MACHINE_C128) {
+    logger->error("linear addresses are only supported on the C128");
+    return false;
+  }
+
+  if(self->end > LINEAR_SIZE) {
+    logger->error("range exceeds both RAM banks: $%05X-$%05X", self->start, self->end);
+    return false;
+  }
+  return true;
+}
+
+//------------------------------------------------------------------------------
+
+static bool command_load_linear(Command* self, unsigned char* data, long size) {
+
+  bool result = false;
+  
+  if(!command_check_linear(self)) {
+    goto done;
+  }
+
+  command_print(self);
+
+  if(!command_server_usable_after_possible_relocation(self)) {
+    goto done;
+  }
+
+  result = xlink_load_linear(self->start, data, size);
+
+ done:
+  free(data);
+  return result;
+}
+
+//------------------------------------------------------------------------------
+
+bool command_load(Command* self) {
+  
+  long size;
+  unsigned char *data;
+  
+  if ((size = command_read_file(self, &data)) < 0) {
+    return false;
+  }
+
+  if(self->linear) {
+    return command_load_linear(self, data, size);
+  }
+  
   if(self->memory == 0xff || self->bank == 0xff) {
 
     Range* io = range_new_from_int(machine->io);
-    Range* data = range_new(self->start, self->end);
+    Range* range = range_new(self->start, self->end);
 
-    if(range_overlaps(data, io) && self->memory == 0xff)
+    if(range_overlaps(range, io) && self->memory == 0xff)
       command_apply_safe_memory_and_bank(self);
     else 
       command_apply_memory_and_bank(self);
 
     free(io);
-    free(data);
+    free(range);
   }
 
-  data = (unsigned char*) calloc(size, sizeof(unsigned char));
-  
-  fseek(file, self->skip, SEEK_SET);
-  fread(data, sizeof(unsigned char), size, file);
-  fclose(file);  
-
   command_print(self);
 
   if(self->force) logger->suspend();
@@ -739,11 +958,22 @@ bool command_save(Command* self) {
     return false;
   }
 
-  command_apply_memory_and_bank(self);
+  if(self->linear) {
+    if(!command_check_linear(self)) {
+      free(data);
+      fclose(file);
+      return false;
+    }
+  }
+  else {
+    command_apply_memory_and_bank(self);
+  }
   
   command_print(self);
 
-  if(!xlink_save(self->memory, self->bank, self->start, data, size)) {
+  if(!(self->linear ?
+       xlink_save_linear(self->start, data, size) :
+       xlink_save(self->memory, self->bank, self->start, data, size))) {
     free(data);
     fclose(file);
     return false;
@@ -875,114 +1105,378 @@ bool command_fill(Command* self) {
 
 //------------------------------------------------------------------------------
 
-bool command_jump(Command* self) {
-
-  if (self->argc == 0) {
-    logger->error("no address specified");
-    return false;
-  }
+static int command_parse_bytes(char* str, unsigned char* bytes, unsigned char* mask, int max) {
 
-  int address = strtol(self->argv[0], NULL, 0);
+  int count = 0;
+  char *token, *end;
+  
+  for(token = strtok(str, ","); token != NULL; token = strtok(NULL, ",")) {
 
-  if(address == 0) {
-    if(self->start != -1) {
-      address = self->start;
+    if(count == max) {
+      logger->error("pattern too long (at most %d bytes)", max);
+      return -1;
     }
-    else {
-      logger->error("no address specified");
-      return false;    
+    
+    if(strcmp(token, "*") == 0 || strcmp(token, "?") == 0) {
+      bytes[count] = 0x00;
+      mask[count++] = 0x00;
+      continue;
     }
-  }
-  command_apply_memory_and_bank(self);
 
-  command_print(self);
+    bytes[count] = (unsigned char) strtol(token, &end, 0);
+    mask[count++] = 0xff;
 
-  return xlink_jump(self->memory, self->bank, address);
+    if(*end != '\0') {
+      logger->error("invalid byte value: %s", token);
+      return -1;
+    }
+  }
+  return count;
 }
 
 //------------------------------------------------------------------------------
 
-bool command_run(Command* self) {
+bool command_hunt(Command* self) {
+
   bool result = false;
+  unsigned char pattern[16];
+  unsigned char mask[16];
+  unsigned char explicit[16];
+  unsigned char ignored[16];
+  unsigned short matches[MAX_REPORTED+1];
+  unsigned int count;
+  int length;
+  
+  if (self->argc == 0) {
+    logger->error("no pattern specified");
+    goto done;
+  }
 
-  if(self->argc == 1) {
+  if((length = command_parse_bytes(self->argv[0], pattern, mask, sizeof(pattern))) <= 0) {
+    if(length == 0) logger->error("empty pattern");
+    goto done;
+  }
 
-    logger->suspend();
-    if(!(result = command_load(self))) {
-      logger->resume();
-      return result;
+  if(self->argc > 1) {
+    if(command_parse_bytes(self->argv[1], explicit, ignored, sizeof(explicit)) != length) {
+      logger->error("mask must have the same length as the pattern");
+      goto done;
     }
-    logger->resume();
-
-    if (self->start != machine->default_basic_start) {
-
-      command_apply_memory_and_bank(self);
-      
-      command_print(self);
-
-      return xlink_jump(self->memory, self->bank, self->start);
+    for(int i=0; i<length; i++) {
+      mask[i] &= explicit[i];
     }
   }
-  command_print(self);
-  return xlink_run();
-}
 
-//------------------------------------------------------------------------------
-
-extern bool xlink_relocate(unsigned short address);
-
-bool command_server_usable_after_possible_relocation(Command* self) {
+  if(self->start == -1) self->start = 0x0000;
+  if(self->end == -1) self->end = 0x10000;
 
-  unsigned short newServerAddress;  
-  xlink_server_info_t server;
-  
-  if(xlink_identify(&server)) {
+  command_apply_memory_and_bank(self);
 
-    if(command_requires_server_relocation(self, &server)) {
+  command_print(self);
 
-      if(!command_server_relocation_possible(self, &server, &newServerAddress)) {
-        logger->error("impossible to relocate ram-based server: out of memory");
-        return false;
-      }
+  if(!xlink_hunt(self->memory, self->bank, self->start, self->end - self->start,
+                 pattern, mask, length, matches, MAX_REPORTED+1, &count)) {
+    goto done;
+  }
 
-      logger->debug("relocating server to $%04X", newServerAddress);
+  for(int i=0; i<count && i<MAX_REPORTED; i++) {
+    printf("$%04X\n", matches[i]);
+  }
 
-      if(!xlink_relocate(newServerAddress)) {
-        logger->error("failed to relocate ram-based server: %s", xlink_error->message);
-        return false;
-      }
-    }
-    return true;
+  if(count > MAX_REPORTED) {
+    logger->info("more than %d matches, narrow down the address range", MAX_REPORTED);
   }
-  return false;
+  
+  result = true;
+  
+ done:
+  return result;
 }
 
 //------------------------------------------------------------------------------
 
-bool command_requires_server_relocation(Command* self, xlink_server_info_t* server) {
+bool command_compare(Command* self) {
 
   bool result = false;
-
-  if(server->type == XLINK_SERVER_TYPE_ROM) {
+  unsigned short mismatches[MAX_REPORTED];
+  unsigned int count;
+  unsigned char *data;
+  long size;
+  
+  if ((size = command_read_file(self, &data)) < 0) {
     return false;
   }
 
-  Range* data = range_new(self->start, self->end);
-  Range* code = range_new(server->start, server->end);
+  command_apply_memory_and_bank(self);
 
-  if(range_overlaps(data, code)) {
-    
-    logger->debug("relocation required: data ($%04X-$%04X) overlaps server ($%04X-$%04X)",
-		  self->start, self->end, server->start, server->end);
-    
-    result = true;
+  command_print(self);
+
+  if(!xlink_compare(self->memory, self->bank, self->start, data, size,
+                    mismatches, MAX_REPORTED, &count)) {
+    goto done;
   }
-  free(data);
-  free(code);
-  return result;  
-}
 
-//------------------------------------------------------------------------------
+  for(int i=0; i<count && i<MAX_REPORTED; i++) {
+    printf("$%04X: expected $%02X\n",
+           mismatches[i], data[(unsigned short) (mismatches[i] - self->start)]);
+  }
+
+  if(count > MAX_REPORTED) {
+    logger->info("more than %d mismatches, only the first %d shown", MAX_REPORTED, MAX_REPORTED);
+  }
+  
+  if(count) {
+    logger->error("%d of %ld bytes differ", count, size);
+    goto done;
+  }
+  
+  result = true;
+  
+ done:
+  free(data);
+  return result;
+}
+
+//------------------------------------------------------------------------------
+
+static bool command_transfer(Command* self, const char* name, long limit,
+                             bool (*load)(uint, uchar*, uint),
+                             bool (*save)(uint, uchar*, uint),
+                             bool (*fill)(uint, uchar, uint)) {
+
+  bool result = false;
+  unsigned char *data = NULL;
+  long size;
+  FILE *file;
+  
+  if (self->argc == 0) {
+    logger->error("no %s command specified (load, save, fill%s)", self->name,
+                  self->id == COMMAND_REU ? " or benchmark" : "");
+    return false;
+  }
+
+  char *action = self->argv[0];
+
+  self->argc--;
+  self->argv++;
+  self->offset++;
+
+  if(self->start >= limit || self->end > limit ||
+     (self->end != -1 && self->end <= self->start)) {
+    logger->error("invalid %s range: $%06X-$%06X", name, self->start, self->end);
+    goto done;
+  }
+  
+  if(strcmp(action, "load") == 0) {
+
+    if(self->start == -1) {
+      self->start = 0; // plain binary file without load address
+    }
+    
+    if ((size = command_read_file(self, &data)) < 0) {
+      goto done;
+    }
+
+    if(self->start + size > limit) {
+      logger->error("file exceeds %s address space", name);
+      goto done;
+    }
+    
+    command_print(self);
+    result = load(self->start, data, size);
+  }
+  else if(strcmp(action, "save") == 0) {
+
+    if (self->argc == 0) {
+      logger->error("no file specified");
+      goto done;
+    }
+
+    if (self->start == -1 || self->end == -1) {
+      logger->error("no %s range specified", name);
+      goto done;
+    }
+
+    command_print(self);
+    
+    size = self->end - self->start;
+    data = (unsigned char*) calloc(size, sizeof(unsigned char));
+
+    if(!save(self->start, data, size)) {
+      goto done;
+    }
+    
+    if ((file = fopen(self->argv[0], "wb")) == NULL) {
+      logger->error("'%s': %s", self->argv[0], strerror(errno));
+      goto done;
+    }
+
+    fwrite(data, sizeof(unsigned char), size, file);
+    fclose(file);
+    result = true;
+  }
+  else if(strcmp(action, "fill") == 0) {
+
+    if (self->argc < 2) {
+      logger->error("usage: %s fill <range> <value>", self->name);
+      goto done;
+    }
+
+    Range *range = range_parse(self->argv[0]);
+    range->max = limit;
+
+    if(!range_ends(range)) {
+      range->end = limit;
+    }
+
+    if(!range_valid(range) || range->start == range->end) {
+      logger->error("invalid %s range: $%06X-$%06X", name, range->start, range->end);
+      free(range);
+      goto done;
+    }
+
+    unsigned char value = (unsigned char) strtol(self->argv[1], NULL, 0);
+
+    command_print(self);
+    result = fill(range->start, value, range_size(range));
+    free(range);
+  }
+  else if(self->id == COMMAND_REU && strcmp(action, "benchmark") == 0) {
+    result = command_benchmark(self);
+  }
+  else {
+    logger->error("unknown %s command: %s", self->name, action);
+  }
+
+ done:
+  free(data);
+  return result;
+}
+
+//------------------------------------------------------------------------------
+
+bool command_reu(Command* self) {
+  return command_transfer(self, "REU", REU_SIZE,
+                          xlink_reu_load, xlink_reu_save, xlink_reu_fill);
+}
+
+//------------------------------------------------------------------------------
+
+bool command_vdc(Command* self) {
+  return command_transfer(self, "VDC", VDC_SIZE,
+                          xlink_vdc_load, xlink_vdc_save, xlink_vdc_fill);
+}
+
+//------------------------------------------------------------------------------
+
+bool command_jump(Command* self) {
+
+  if (self->argc == 0) {
+    logger->error("no address specified");
+    return false;
+  }
+
+  int address = strtol(self->argv[0], NULL, 0);
+
+  if(address == 0) {
+    if(self->start != -1) {
+      address = self->start;
+    }
+    else {
+      logger->error("no address specified");
+      return false;    
+    }
+  }
+  command_apply_memory_and_bank(self);
+
+  command_print(self);
+
+  return xlink_jump(self->memory, self->bank, address);
+}
+
+//------------------------------------------------------------------------------
+
+bool command_run(Command* self) {
+  bool result = false;
+
+  if(self->argc == 1) {
+
+    logger->suspend();
+    if(!(result = command_load(self))) {
+      logger->resume();
+      return result;
+    }
+    logger->resume();
+
+    if (self->start != machine->default_basic_start) {
+
+      command_apply_memory_and_bank(self);
+      
+      command_print(self);
+
+      return xlink_jump(self->memory, self->bank, self->start);
+    }
+  }
+  command_print(self);
+  return xlink_run();
+}
+
+//------------------------------------------------------------------------------
+
+extern bool xlink_relocate(unsigned short address);
+
+bool command_server_usable_after_possible_relocation(Command* self) {
+
+  unsigned short newServerAddress;  
+  xlink_server_info_t server;
+  
+  if(xlink_identify(&server)) {
+
+    if(command_requires_server_relocation(self, &server)) {
+
+      if(!command_server_relocation_possible(self, &server, &newServerAddress)) {
+        logger->error("impossible to relocate ram-based server: out of memory");
+        return false;
+      }
+
+      logger->debug("relocating server to $%04X", newServerAddress);
+
+      if(!xlink_relocate(newServerAddress)) {
+        logger->error("failed to relocate ram-based server: %s", xlink_error->message);
+        return false;
+      }
+    }
+    return true;
+  }
+  return false;
+}
+
+//------------------------------------------------------------------------------
+
+bool command_requires_server_relocation(Command* self, xlink_server_info_t* server) {
+
+  bool result = false;
+
+  if(server->type == XLINK_SERVER_TYPE_ROM) {
+    return false;
+  }
+
+  Range* data = range_new(self->start, self->end);
+  Range* code = range_new(server->start, server->end);
+
+  if(range_overlaps(data, code)) {
+    
+    logger->debug("relocation required: data ($%04X-$%04X) overlaps server ($%04X-$%04X)",
+		  self->start, self->end, server->start, server->end);
+    
+    result = true;
+  }
+  free(data);
+  free(code);
+  return result;  
+}
+
+//------------------------------------------------------------------------------
 
 bool command_server_relocation_possible(Command* self, xlink_server_info_t* server, unsigned short* address) {
 
@@ -1138,6 +1632,181 @@ bool command_relocate(Command *self) {
 
 //------------------------------------------------------------------------------
 
+bool command_stub(Command *self) {
+
+  command_print(self);
+
+  if(!xlink_stub()) {
+    logger->error("failed to install resident stub: %s", xlink_error->message);
+    return false;
+  }
+  return true;
+}
+
+//------------------------------------------------------------------------------
+
+bool command_handler(Command *self) {
+
+  bool result = false;
+  long size;
+  unsigned char *data;
+
+  if(self->argc != 2) {
+    logger->error("no handler file and extension command specified");
+    return false;
+  }
+
+  uchar id = strtol(self->argv[1], NULL, 0);
+  
+  if ((size = command_read_file(self, &data)) < 0) {
+    return false;
+  }
+
+  command_print(self);
+
+  if(!(result = xlink_register_handler(id, self->start, data, size))) {
+    logger->error("failed to register handler: %s", xlink_error->message);
+  }
+
+  free(data);
+  return result;
+}
+
+//------------------------------------------------------------------------------
+
+static volatile sig_atomic_t serving = false;
+
+static void command_serve_interrupt(int sig) {
+  serving = false;
+}
+
+static bool command_serve_request(Disk* disk, xlink_request_t* request) {
+
+  char name[256];
+  unsigned char *data;
+  long size;
+  int status;
+  
+  disk_name(request->name, name, sizeof(name));
+  
+  if(request->type == XLINK_SERVE_LOAD) {
+
+    ushort address = request->start;
+    
+    if((status = disk_load(disk, request->name, &data, &size)) == DISK_OK) {
+      if(size < 2) {
+        status = DISK_FILE_NOT_FOUND;
+      }
+      else if(request->secondary != 0) {
+        address = data[0] | data[1] << 8;
+      }
+    }
+
+    if(status == DISK_OK) {
+      logger->info("load \"%s\" to $%04X-$%04X", name, address, address + size - 2);
+    }
+    else {
+      logger->warn("load \"%s\": error %d", name, status);
+    }
+    
+    bool result = xlink_serve_load(status, address, status == DISK_OK ? data+2 : NULL, size-2);
+    free(data);
+    return result;
+  }
+
+  if(request->type == XLINK_SERVE_SAVE) {
+
+    size = request->end - request->start;
+    data = (unsigned char*) calloc(size+2, sizeof(unsigned char));
+    data[0] = lo(request->start);
+    data[1] = hi(request->start);
+    if(size > 0) memcpy(data+2, request->data, size);
+    
+    if((status = disk_save(disk, request->name, data, size+2)) == DISK_OK) {
+      logger->info("save \"%s\" from $%04X-$%04X", name, request->start, request->end);
+    }
+    else {
+      logger->warn("save \"%s\": error %d", name, status);
+    }
+    
+    free(data);
+    free(request->data);
+    return xlink_serve_save(status);
+  }
+  
+  return true;
+}
+
+bool command_serve(Command *self) {
+
+  xlink_server_info_t server;
+  xlink_request_t request;
+  Disk *disk;
+  int device = SERVE_DEVICE;
+  
+  if(self->argc < 1) {
+    logger->error("no directory or d64 image specified");
+    return false;
+  }
+
+  if(self->argc > 1) {
+    device = strtol(self->argv[1], NULL, 0);
+
+    if(device < 8 || device > 30) {
+      logger->error("invalid device number: %d", device);
+      return false;
+    }
+  }
+  
+  if((disk = disk_new(self->argv[0])) == NULL) {
+    logger->error("%s: not a directory or d64 image", self->argv[0]);
+    return false;
+  }
+
+  command_print(self);
+  
+  if(!xlink_identify(&server) || !(server.capabilities & XLINK_CAPABILITY_DISK)) {
+    logger->error("the server does not support serving disk access");
+    disk_free(disk);
+    return false;
+  }
+
+  logger->info("serving device %d from %s (press ctrl-c to stop)", device, self->argv[0]);
+  
+  serving = true;
+  signal(SIGINT, command_serve_interrupt);
+  
+  while(serving) {
+
+    if(!xlink_serve_poll(device, &request)) {
+      logger->debug("poll failed: %s", xlink_error->message);
+      usleep(500*1000);
+      continue;
+    }
+
+    if(request.type == XLINK_SERVE_NONE) {
+      usleep(20*1000);
+      continue;
+    }
+    
+    if(!command_serve_request(disk, &request)) {
+      logger->error("failed to serve request: %s", xlink_error->message);
+    }
+  }
+
+  signal(SIGINT, SIG_DFL);
+
+  // stop redirecting the device
+  
+  xlink_serve_poll(0, &request);
+  free(request.data);
+  
+  disk_free(disk);
+  return true;
+}
+
+//------------------------------------------------------------------------------
+
 static bool server_ready_after(int ms) {
 
   while(ms) {
@@ -1178,17 +1847,109 @@ int command_bootloader(Command *self) {
 
 //------------------------------------------------------------------------------
 
+static int compare_latency(const void* a, const void* b) {
+  double difference = *(double*) a - *(double*) b;
+  return difference < 0 ? -1 : (difference > 0 ? 1 : 0);
+}
+
+static bool command_benchmark_loopback(Command* self) {
+
+  // with the adapter simulating the peer, measure the raw transfer rate
+  // and the latency of single byte requests through the host and USB
+  // path alone
+
+  int size = (self->start != -1 && self->end != -1) ? self->end - self->start : 0x10000;
+  double latency[LOOPBACK_REQUESTS];
+  bool result = false;
+
+  command_print(self);
+
+  if(size <= 0) {
+    logger->error("invalid benchmark size: %d", size);
+    return false;
+  }
+  
+  unsigned char *payload = (unsigned char*) calloc(size, sizeof(unsigned char));
+  Watch* watch = watch_new();
+  
+  if(!xlink_loopback(true)) {
+    goto done;
+  }
+
+  xlink_begin();
+  
+  logger->info("sending %d bytes...", size);
+  watch_start(watch);
+
+  if(!xlink_send(payload, size)) goto end;
+
+  float seconds = (watch_elapsed(watch) / 1000.0);
+  logger->info("%.3f seconds at %.2f kb/s", seconds, size/seconds/1024);
+
+  logger->info("receiving %d bytes...", size);
+  watch_start(watch);
+
+  if(!xlink_receive(payload, size)) goto end;
+
+  seconds = (watch_elapsed(watch) / 1000.0);
+  logger->info("%.3f seconds at %.2f kb/s", seconds, size/seconds/1024);
+
+  for(int i=0; i<size; i++) {
+    if(payload[i] != (unsigned char) i) {
+      logger->error("loopback error at offset %d: expected %d, received %d",
+                    i, (unsigned char) i, payload[i]);
+      goto end;
+    }
+  }
+  
+  logger->info("sending %d single bytes...", LOOPBACK_REQUESTS);
+  
+  for(int i=0; i<LOOPBACK_REQUESTS; i++) {
+    watch_start(watch);
+    if(!xlink_send(payload, 1)) goto end;
+    latency[i] = watch_elapsed(watch);
+  }
+
+  qsort(latency, LOOPBACK_REQUESTS, sizeof(double), compare_latency);
+
+  logger->info("latency min %.2fms, median %.2fms, 90%% %.2fms, 99%% %.2fms, max %.2fms",
+               latency[0],
+               latency[LOOPBACK_REQUESTS/2],
+               latency[LOOPBACK_REQUESTS*90/100],
+               latency[LOOPBACK_REQUESTS*99/100],
+               latency[LOOPBACK_REQUESTS-1]);
+  result = true;
+
+ end:
+  xlink_end();
+  xlink_loopback(false);
+  
+ done:
+  watch_free(watch);
+  free(payload);
+  return result;
+}
+
 bool command_benchmark(Command* self) {
 
+  if(self->loopback) {
+    return command_benchmark_loopback(self);
+  }
+  
   Watch* watch = watch_new();
   bool result = false;
   xlink_server_info_t server;
   
   Range *benchmark;
 
+  bool reu = self->id == COMMAND_REU;
+  
   if(self->start != -1 && self->end != -1) {
     benchmark = range_new(self->start, self->end);
   }
+  else if(reu) {
+    benchmark = range_new(0x0000, 0x10000);
+  }
   else {
     benchmark = range_new_from_int(machine->benchmark);
   }
@@ -1212,7 +1973,12 @@ bool command_benchmark(Command* self) {
     goto done;
   }
 
-  if(xlink_identify(&server)) {
+  if(!reu && xlink_identify(&server)) {
+    if(server.capabilities & XLINK_CAPABILITY_FAST) {
+      logger->info((self->memory & 0x80) ?
+                   "2MHz mode available but disabled (screen kept on)" :
+                   "transfers run in 2MHz mode");
+    }
     if(server.type == XLINK_SERVER_TYPE_RAM) {
       xlink_relocate(machine->free_ram_area);
       usleep(250*1000);
@@ -1223,7 +1989,10 @@ bool command_benchmark(Command* self) {
     
   watch_start(watch);
 
-  if(!xlink_load(self->memory, self->bank, start, payload, sizeof(payload))) goto done;
+  if(reu) {
+    if(!xlink_reu_load(start, payload, sizeof(payload))) goto done;
+  }
+  else if(!xlink_load(self->memory, self->bank, start, payload, sizeof(payload))) goto done;
   
   float seconds = (watch_elapsed(watch) / 1000.0);
   float kbs = sizeof(payload)/seconds/1024;
@@ -1234,7 +2003,10 @@ bool command_benchmark(Command* self) {
     
   watch_start(watch);
 
-  if(!xlink_save(self->memory, self->bank, start, roundtrip, sizeof(roundtrip))) goto done;
+  if(reu) {
+    if(!xlink_reu_save(start, roundtrip, sizeof(roundtrip))) goto done;
+  }
+  else if(!xlink_save(self->memory, self->bank, start, roundtrip, sizeof(roundtrip))) goto done;
   
   seconds = (watch_elapsed(watch) / 1000.0);
   kbs = sizeof(payload)/seconds/1024;
@@ -1245,7 +2017,8 @@ bool command_benchmark(Command* self) {
   
   for(int i=0; i<sizeof(payload); i++) {
     if(payload[i] != roundtrip[i]) {
-      logger->error("roundtrip error at $%04X: sent %d, received %d", start+i, payload[i], roundtrip[i]);
+      logger->error(reu ? "roundtrip error at $%06X: sent %d, received %d" :
+                    "roundtrip error at $%04X: sent %d, received %d", start+i, payload[i], roundtrip[i]);
       result = false;
       goto done;
     }
@@ -1268,13 +2041,30 @@ bool command_identify(Command *self) {
   
   if(xlink_identify(&server)) {
 
-    printf("%s %d.%d %s %s $%04X-$%04X\n",
+    printf("%s %d.%d %s %s $%04X-$%04X",
            server.id,
            (server.version & 0xf0) >> 4, server.version & 0x0f,
            server.machine == XLINK_MACHINE_C64 ? "C64" : (XLINK_MACHINE_C128 ? "C128" : "Unknown"),
            server.type == XLINK_SERVER_TYPE_RAM ? "RAM" : "ROM",
            server.start, server.end);
 
+    if(server.capabilities & XLINK_CAPABILITY_HUNT)    printf(" hunt");
+    if(server.capabilities & XLINK_CAPABILITY_COMPARE) printf(" compare");
+    if(server.capabilities & XLINK_CAPABILITY_SESSION) printf(" session");
+    if(server.capabilities & XLINK_CAPABILITY_LOADZ)   printf(" loadz");
+    if(server.capabilities & XLINK_CAPABILITY_REU)     printf(" reu");
+    if(server.capabilities & XLINK_CAPABILITY_FILL)    printf(" fill");
+    if(server.capabilities & XLINK_CAPABILITY_FAST)    printf(" 2mhz");
+    if(server.capabilities & XLINK_CAPABILITY_LINEAR)  printf(" linear");
+    if(server.capabilities & XLINK_CAPABILITY_VDC)     printf(" vdc");
+    if(server.capabilities & XLINK_CAPABILITY_OVERLAY) printf(" overlay");
+    if(server.capabilities & XLINK_CAPABILITY_RELOCATE) printf(" relocate");
+    if(server.capabilities & XLINK_CAPABILITY_EXTENSION) printf(" extensions");
+    if(server.capabilities & XLINK_CAPABILITY_DISK)    printf(" disk");
+    printf("\n");
+
+    logger->debug("protocol version %d", server.protocol);
+
     return true;
   }
   return false;
@@ -1441,6 +2231,116 @@ bool command_ping(Command* self) {
 
 //------------------------------------------------------------------------------
 
+bool command_devices(Command* self) {
+
+  xlink_device_t devices[32];
+  char* selected = NULL;
+  int count;
+  bool reachable;
+  double latency = 0;
+
+  command_print(self);
+  
+  if(!xlink_devices(devices, sizeof(devices)/sizeof(xlink_device_t), &count)) {
+    return false;
+  }
+
+  if(count == 0) {
+    logger->info("no devices found");
+    return true;
+  }
+
+  if(xlink_get_device() != NULL) {
+    selected = strdup(xlink_get_device());
+  }
+  
+  Watch *watch = watch_new();
+  
+  for(int i=0; i<count; i++) {
+
+    xlink_device_t* device = &devices[i];
+    
+    printf("%-24s %-8s", device->path, device->type);
+
+    if(strcmp(device->type, "usb") == 0) {
+      printf(" %03d/%03d", device->bus, device->address);
+
+      if(device->firmware) {
+        printf(" firmware %x.%02x", device->firmware >> 8, device->firmware & 0xff);
+      }
+    }
+
+    logger->suspend();
+    
+    if((reachable = xlink_set_device(device->path))) {
+      watch_start(watch);
+      reachable = xlink_ping();
+      latency = watch_elapsed(watch);
+    }
+    logger->resume();
+
+    if(reachable) {
+      printf(" ping %.1fms\n", latency);
+    }
+    else {
+      printf(" no reply\n");
+    }
+  }
+  watch_free(watch);
+
+  if(selected != NULL) {
+    xlink_set_device(selected);
+    free(selected);
+  }
+  return true;
+}
+
+//------------------------------------------------------------------------------
+
+bool command_stats(Command* self) {
+
+  const char* buckets[XLINK_STATS_BUCKETS] = {
+    "<16us", "<128us", "<1ms", "<8ms", "<65ms", "longer"
+  };
+  xlink_stats_t stats;
+  bool clear = false;
+  uint total = 0;
+
+  command_print(self);
+
+  if(self->argc > 0) {
+    if(strcmp(self->argv[0], "clear") != 0) {
+      logger->error("unknown argument: %s", self->argv[0]);
+      return false;
+    }
+    clear = true;
+  }
+
+  if(!xlink_stats(&stats, clear)) {
+    return false;
+  }
+
+  printf("sent     %10u bytes\n", stats.sent);
+  printf("received %10u bytes\n", stats.received);
+  printf("packets  %10u\n", stats.packets);
+  printf("timeouts %10u\n", stats.timeouts);
+  printf("resets   %10u\n", stats.resets);
+
+  for(int i=0; i<XLINK_STATS_BUCKETS; i++) {
+    total += stats.waits[i];
+  }
+
+  printf("\nACK waits\n");
+
+  for(int i=0; i<XLINK_STATS_BUCKETS; i++) {
+    printf("%-8s %10u %5.1f%%\n", buckets[i], stats.waits[i],
+           total ? stats.waits[i] * 100.0 / total : 0.0);
+  }
+  return true;
+}
+
+//------------------------------------------------------------------------------
+
 bool command_execute(Command* self) {
 
   bool result = false;
@@ -1474,8 +2374,17 @@ bool command_execute(Command* self) {
   case COMMAND_IDENTIFY   : result = command_identify(self);   break;
   case COMMAND_SERVER     : result = command_server(self);     break;
   case COMMAND_RELOCATE   : result = command_relocate(self);   break;
+  case COMMAND_STUB       : result = command_stub(self);       break;
+  case COMMAND_HANDLER    : result = command_handler(self);    break;
+  case COMMAND_SERVE      : result = command_serve(self);      break;
+  case COMMAND_DEVICES    : result = command_devices(self);    break;
+  case COMMAND_STATS      : result = command_stats(self);      break;
   case COMMAND_KERNAL     : result = command_kernal(self);     break;            
   case COMMAND_FILL       : result = command_fill(self);       break;            
+  case COMMAND_HUNT       : result = command_hunt(self);       break;            
+  case COMMAND_COMPARE    : result = command_compare(self);    break;            
+  case COMMAND_REU        : result = command_reu(self);        break;            
+  case COMMAND_VDC        : result = command_vdc(self);        break;            
   }
   
   logger->leave();
@@ -1493,6 +2402,8 @@ int main(int argc, char **argv) {
   logger->set("INFO");
   logger->enter(argv[0]);
 
+  xlink_set_compression(XLINK_COMPRESSION_AUTO);
+
   argc--; argv++;
 
   if (argc == 0) {
@@ -1547,6 +2458,10 @@ void usage(void) {
   printf("    -b, --bank                    : C128 bank value (default: 15)\n");
   printf("    -a, --address <start>[-<end>] : address/range (default: autodetect)\n");
   printf("    -s, --skip <n>                : Skip n bytes of file\n");
+  printf("    -k, --keep-screen             : don't blank the screen or switch to 2MHz (C128)\n");
+  printf("    -l, --linear                  : 17 bit addresses spanning both C128 RAM banks\n");
+  printf("    -z, --compress <mode>         : compress loads: auto, always, never (default: auto)\n");
+  printf("    -L, --loopback                : benchmark the adapter alone, in loopback mode\n");
   printf("\n");
   printf("Commands:\n");
   printf("     help  [<command>]            : show detailed help for command\n");
@@ -1554,17 +2469,26 @@ void usage(void) {
   printf("     kernal <infile> <outfile>    : patch kernal image to include server code\n");
   printf("     server [-a<addr>] <file>     : create server program and save to file\n");
   printf("     relocate <addr>              : relocate currently running server\n");
+  printf("     stub                         : replace running server with resident stub\n");
+  printf("     handler <file> <command>     : register file as handler for an extension command\n");
+  printf("     serve <dir|d64> [<device>]   : serve LOAD and SAVE of a device until interrupted\n");
   printf("\n");  
   printf("     reset                        : reset machine (requires hardware support)\n");
   printf("     ready                        : try to make sure the server is ready\n");
   printf("     ping                         : check if the server is available\n");
   printf("     identify                     : identify remote server and machine type\n");
+  printf("     devices                      : list transfer devices with ping latency\n");
+  printf("     stats [clear]                : show (and clear) the adapter's transfer counters\n");
   printf("\n");
   printf("     load  [<opts>] <file>        : load file into memory\n");
   printf("     save  [<opts>] <file>        : save memory to file\n");
   printf("     poke  [<opts>] <addr>,<val>  : poke value into memory\n");
   printf("     peek  [<opts>] <addr>        : read value from memory\n");
   printf("     fill  <range>  <val>         : fill memory range with value\n");
+  printf("     hunt  [<opts>] <bytes> [<mask>]: search memory for byte pattern\n");
+  printf("     compare [<opts>] <file>      : compare file with memory\n");
+  printf("     reu load|save|fill|benchmark : transfer to/from RAM expansion unit\n");
+  printf("     vdc load|save|fill           : transfer to/from C128 VDC RAM\n");
   printf("     jump  [<opts>] <addr>        : jump to specified address\n");
   printf("     run   [<opts>] [<file>]      : run program, optionally load it before\n");
   printf("     <file>...                    : load file(s) and run last file\n");
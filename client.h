@@ -16,6 +16,8 @@ typedef struct {
   char **argv; 
   int offset;
   int force;
+  bool linear;
+  bool loopback;
 } Command;
 
 typedef struct {
@@ -46,6 +48,7 @@ bool command_server_relocation_possible(Command* self, xlink_server_info_t* serv
 
 Command* command_new(int *argc, char ***argv);
 int command_arity(Command* self);
+bool command_batchable(Command* self);
 void command_consume_arguments(Command *self, int *argc, char ***argv);
 void command_append_argument(Command* self, char* arg);
 bool command_parse_options(Command *self);
@@ -61,6 +64,10 @@ bool command_save(Command* self);
 bool command_poke(Command* self);
 bool command_peek(Command* self);
 bool command_fill(Command* self);
+bool command_hunt(Command* self);
+bool command_compare(Command* self);
+bool command_reu(Command* self);
+bool command_vdc(Command* self);
 bool command_jump(Command* self);
 bool command_run(Command* self);
 bool command_ready(Command* self);
@@ -73,6 +80,11 @@ bool command_benchmark(Command *self);
 bool command_identify(Command *self);
 bool command_server(Command *self);
 bool command_relocate(Command *self);
+bool command_stub(Command *self);
+bool command_handler(Command *self);
+bool command_serve(Command *self);
+bool command_devices(Command *self);
+bool command_stats(Command *self);
 bool command_kernal(Command *self);
 void command_free(Command* self);
 
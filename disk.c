@@ -0,0 +1,323 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "disk.h"
+
+#define D64_SIZE       174848
+#define D64_DIRECTORY  18
+#define D64_TRACKS     35
+#define D64_ENTRY_SIZE 32
+#define D64_NAME_SIZE  16
+#define D64_PRG        0x82
+
+static bool disk_is_image(char *path) {
+  size_t len = strlen(path);
+  return len > 4 && strcasecmp(path + len - 4, ".d64") == 0;
+}
+
+Disk* disk_new(char *path) {
+
+  struct stat st;
+  FILE *file;
+  
+  Disk* self = (Disk*) calloc(1, sizeof(Disk));
+  self->path = strdup(path);
+  self->image = disk_is_image(path);
+
+  if(stat(path, &st) != 0) goto error;
+  
+  if(!self->image) {
+    if(!S_ISDIR(st.st_mode)) goto error;
+    return self;
+  }
+
+  if(st.st_size < D64_SIZE) goto error;
+  
+  if((file = fopen(path, "rb")) == NULL) goto error;
+
+  self->size = D64_SIZE; // error information, if present, is ignored
+  self->data = (unsigned char*) calloc(self->size, sizeof(unsigned char));
+  
+  if(fread(self->data, sizeof(unsigned char), self->size, file) != self->size) {
+    fclose(file);
+    goto error;
+  }
+  fclose(file);
+  return self;
+
+ error:
+  disk_free(self);
+  return NULL;
+}
+
+//------------------------------------------------------------------------------
+
+static unsigned char* disk_strip(unsigned char* name) {
+
+  // drop "@", drive "0:" and ",p,r" style type and mode suffixes
+  
+  unsigned char *colon = (unsigned char*) strchr((char*) name, ':');
+  unsigned char *comma;
+  
+  if(colon != NULL) name = colon+1;
+  else if(name[0] == '@') name++;
+
+  if((comma = (unsigned char*) strchr((char*) name, ',')) != NULL) *comma = '\0';
+  
+  return name;
+}
+
+//------------------------------------------------------------------------------
+
+void disk_name(unsigned char* name, char* ascii, int size) {
+
+  // PETSCII as typed in the default character set: unshifted letters are
+  // mapped to lower case, shifted letters to upper case
+  
+  int i;
+  for(i=0; name[i] && i<size-1; i++) {
+    unsigned char c = name[i];
+
+    if(c >= 0x41 && c <= 0x5a) c = c + 0x20;
+    else if(c >= 0xc1 && c <= 0xda) c = c - 0x80;
+    else if(c == '/' || c == '\\' || c < 0x20 || c > 0x7e) c = '_';
+
+    ascii[i] = c;
+  }
+  ascii[i] = '\0';
+}
+
+//------------------------------------------------------------------------------
+
+static bool disk_match(const unsigned char* pattern, const unsigned char* name, int length, bool fold) {
+
+  // fold: ignore case, used for host file names
+  
+  int i;
+  for(i=0; pattern[i]; i++) {
+    if(pattern[i] == '*') return true;
+    if(i == length) return false;
+    if(pattern[i] == '?') continue;
+    if(fold ? tolower(pattern[i]) != tolower(name[i]) : pattern[i] != name[i]) return false;
+  }
+  return i == length;
+}
+
+//------------------------------------------------------------------------------
+
+static long disk_offset(int track, int sector) {
+
+  static const int sectors[] = { 21, 19, 18, 17 };
+  static const int first[] = { 1, 18, 25, 31, 36 };
+  
+  long offset = 0;
+
+  if(track < 1 || track > D64_TRACKS) return -1;
+  
+  for(int zone=0; zone<4; zone++) {
+    for(int t=first[zone]; t<first[zone+1]; t++) {
+      if(t == track) {
+        return sector < sectors[zone] ? (offset + sector) * 256 : -1;
+      }
+      offset += sectors[zone];
+    }
+  }
+  return -1;
+}
+
+//------------------------------------------------------------------------------
+
+static unsigned char* disk_sector(Disk* self, int track, int sector) {
+
+  long offset = disk_offset(track, sector);
+  return offset < 0 ? NULL : self->data + offset;
+}
+
+//------------------------------------------------------------------------------
+
+static int disk_image_load(Disk* self, unsigned char* name, unsigned char** data, long* size) {
+
+  unsigned char *block, *entry = NULL;
+  int track = D64_DIRECTORY, sector = 1;
+  int blocks = 0;
+  
+  // find the first closed PRG file matching name in the directory chain
+  
+  while(entry == NULL && (block = disk_sector(self, track, sector)) != NULL) {
+
+    for(int i=0; i<256; i+=D64_ENTRY_SIZE) {
+      unsigned char *e = block + i;
+      int length = D64_NAME_SIZE;
+      
+      if(e[2] != D64_PRG) continue;
+
+      while(length > 0 && e[5+length-1] == 0xa0) length--;
+      
+      if(disk_match(name, e+5, length, false)) {
+        entry = e;
+        break;
+      }
+    }
+    
+    track = block[0];
+    sector = block[1];
+    
+    if(track == 0 || ++blocks > 18) break;
+  }
+
+  if(entry == NULL) {
+    return DISK_FILE_NOT_FOUND;
+  }
+
+  // follow the file's sector chain, guarding against loops
+  
+  *data = (unsigned char*) calloc(self->size, sizeof(unsigned char));
+  *size = 0;
+  
+  track = entry[3];
+  sector = entry[4];
+  blocks = 0;
+  
+  while((block = disk_sector(self, track, sector)) != NULL) {
+
+    int used = block[0] == 0 ? block[1] - 1 : 254;
+
+    if(used < 0 || ++blocks > self->size / 256) break;
+    
+    memcpy(*data + *size, block + 2, used);
+    *size += used;
+
+    if(block[0] == 0) return DISK_OK;
+    
+    track = block[0];
+    sector = block[1];
+  }
+
+  free(*data);
+  *data = NULL;
+  return DISK_FILE_NOT_FOUND;
+}
+
+//------------------------------------------------------------------------------
+
+static bool disk_read_file(char *path, unsigned char** data, long* size) {
+
+  FILE *file;
+  struct stat st;
+
+  if(stat(path, &st) != 0 || !S_ISREG(st.st_mode)) return false;
+  if((file = fopen(path, "rb")) == NULL) return false;
+
+  *size = st.st_size;
+  *data = (unsigned char*) calloc(*size > 0 ? *size : 1, sizeof(unsigned char));
+  
+  if(fread(*data, sizeof(unsigned char), *size, file) != *size) {
+    free(*data);
+    *data = NULL;
+    fclose(file);
+    return false;
+  }
+  fclose(file);
+  return true;
+}
+
+//------------------------------------------------------------------------------
+
+static int disk_directory_load(Disk* self, unsigned char* name, unsigned char** data, long* size) {
+
+  char pattern[256];
+  char path[strlen(self->path) + 256 + 5];
+  struct dirent *entry;
+  DIR *dir;
+  bool found = false;
+  
+  disk_name(name, pattern, sizeof(pattern));
+
+  if((dir = opendir(self->path)) == NULL) {
+    return DISK_FILE_NOT_FOUND;
+  }
+
+  // match the name as is or without a .prg extension
+  
+  while(!found && (entry = readdir(dir)) != NULL) {
+    int length = strlen(entry->d_name);
+
+    if(entry->d_name[0] == '.') continue;
+    
+    if(length > 4 && strcasecmp(entry->d_name + length - 4, ".prg") == 0) {
+      found = disk_match((unsigned char*) pattern, (unsigned char*) entry->d_name, length - 4, true);
+    }
+    if(!found) {
+      found = disk_match((unsigned char*) pattern, (unsigned char*) entry->d_name, length, true);
+    }
+    if(found) {
+      sprintf(path, "%s/%.255s", self->path, entry->d_name);
+      found = disk_read_file(path, data, size);
+    }
+  }
+  closedir(dir);
+  
+  return found ? DISK_OK : DISK_FILE_NOT_FOUND;
+}
+
+//------------------------------------------------------------------------------
+
+int disk_load(Disk* self, unsigned char* name, unsigned char** data, long* size) {
+
+  *data = NULL;
+  *size = 0;
+  
+  name = disk_strip(name);
+  
+  if(name[0] == '\0') {
+    return DISK_MISSING_NAME;
+  }
+  
+  return self->image ?
+    disk_image_load(self, name, data, size) :
+    disk_directory_load(self, name, data, size);
+}
+
+//------------------------------------------------------------------------------
+
+int disk_save(Disk* self, unsigned char* name, unsigned char* data, long size) {
+
+  char ascii[256];
+  char path[strlen(self->path) + 256 + 5];
+  FILE *file;
+  
+  name = disk_strip(name);
+
+  if(name[0] == '\0') {
+    return DISK_MISSING_NAME;
+  }
+
+  if(self->image || strpbrk((char*) name, "*?") != NULL) {
+    return DISK_NOT_OUTPUT;
+  }
+
+  disk_name(name, ascii, sizeof(ascii));
+  sprintf(path, "%s/%s.prg", self->path, ascii);
+  
+  if((file = fopen(path, "wb")) == NULL) {
+    return DISK_NOT_OUTPUT;
+  }
+
+  bool written = fwrite(data, sizeof(unsigned char), size, file) == size;
+  fclose(file);
+
+  return written ? DISK_OK : DISK_NOT_OUTPUT;
+}
+
+//------------------------------------------------------------------------------
+
+void disk_free(Disk* self) {
+  free(self->data);
+  free(self->path);
+  free(self);
+}
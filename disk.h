@@ -0,0 +1,22 @@
+#ifndef DISK_H
+#define DISK_H
+
+#define DISK_OK             0x00
+#define DISK_FILE_NOT_FOUND 0x04 // kernal error codes returned to the program
+#define DISK_NOT_OUTPUT     0x07
+#define DISK_MISSING_NAME   0x08
+
+typedef struct {
+  char *path;
+  bool image;           // path is a .d64 image rather than a directory
+  unsigned char *data;  // image contents
+  long size;
+} Disk;
+
+Disk* disk_new(char *path);
+int disk_load(Disk* self, unsigned char* name, unsigned char** data, long* size);
+int disk_save(Disk* self, unsigned char* name, unsigned char* data, long size);
+void disk_name(unsigned char* name, char* ascii, int size);
+void disk_free(Disk* self);
+
+#endif // DISK_H
@@ -73,7 +73,7 @@
 		#define FIXED_CONTROL_ENDPOINT_SIZE      64
 		#define DEVICE_STATE_AS_GPIOR            0
 		#define FIXED_NUM_CONFIGURATIONS         1
-		#define CONTROL_ONLY_DEVICE
+//		#define CONTROL_ONLY_DEVICE
 //		#define INTERRUPT_CONTROL_ENDPOINT
 //		#define NO_DEVICE_REMOTE_WAKEUP
 //		#define NO_DEVICE_SELF_POWER
@@ -29,7 +29,7 @@ const USB_Descriptor_Device_t PROGMEM XLink_DeviceDescriptor =
 
 	.VendorID               = 0x1d50,
 	.ProductID              = 0x60c8,
-	.ReleaseNumber          = VERSION_BCD(01.00),
+	.ReleaseNumber          = VERSION_BCD(01.60),
 
 	.ManufacturerStrIndex   = STRING_ID_Manufacturer,
 	.ProductStrIndex        = STRING_ID_Product,
@@ -67,7 +67,7 @@ const USB_Descriptor_Configuration_t PROGMEM XLink_ConfigurationDescriptor =
 			.InterfaceNumber        = 0,
 			.AlternateSetting       = 0,
 
-			.TotalEndpoints         = 0,
+			.TotalEndpoints         = 3,
 
 			.Class                  = USB_CSCP_VendorSpecificClass,
 			.SubClass               = 0x00,
@@ -75,6 +75,36 @@ const USB_Descriptor_Configuration_t PROGMEM XLink_ConfigurationDescriptor =
 
 			.InterfaceStrIndex      = NO_DESCRIPTOR
 		},
+
+	.XLinkOutEndpoint =
+		{
+			.Header                 = {.Size = sizeof(USB_Descriptor_Endpoint_t), .Type = DTYPE_Endpoint},
+
+			.EndpointAddress        = XLINK_OUT_EPADDR,
+			.Attributes             = (EP_TYPE_BULK | ENDPOINT_ATTR_NO_SYNC | ENDPOINT_USAGE_DATA),
+			.EndpointSize           = XLINK_EPSIZE,
+			.PollingIntervalMS      = 0x05
+		},
+
+	.XLinkInEndpoint =
+		{
+			.Header                 = {.Size = sizeof(USB_Descriptor_Endpoint_t), .Type = DTYPE_Endpoint},
+
+			.EndpointAddress        = XLINK_IN_EPADDR,
+			.Attributes             = (EP_TYPE_BULK | ENDPOINT_ATTR_NO_SYNC | ENDPOINT_USAGE_DATA),
+			.EndpointSize           = XLINK_EPSIZE,
+			.PollingIntervalMS      = 0x05
+		},
+
+	.XLinkEventEndpoint =
+		{
+			.Header                 = {.Size = sizeof(USB_Descriptor_Endpoint_t), .Type = DTYPE_Endpoint},
+
+			.EndpointAddress        = XLINK_EVENT_EPADDR,
+			.Attributes             = (EP_TYPE_INTERRUPT | ENDPOINT_ATTR_NO_SYNC | ENDPOINT_USAGE_DATA),
+			.EndpointSize           = XLINK_EVENT_EPSIZE,
+			.PollingIntervalMS      = 0x01
+		},
 };
 
 /** Language descriptor structure. This descriptor, located in FLASH memory, is returned when the host requests
@@ -5,6 +5,23 @@
 		#include <avr/pgmspace.h>
 		#include <LUFA/Drivers/USB/USB.h>
 
+		#include "../protocol.h"
+
+	/* Macros: */
+		/** Endpoint address and size of the bulk endpoints carrying send/receive payloads. */
+		#define XLINK_OUT_EPADDR          BULK_OUT_ENDPOINT
+		#define XLINK_IN_EPADDR           BULK_IN_ENDPOINT
+		#define XLINK_EPSIZE              BULK_ENDPOINT_SIZE
+
+		/** Endpoint address and size of the interrupt endpoint reporting ACK edges and resets. */
+		#define XLINK_EVENT_EPADDR        EVENT_ENDPOINT
+		#define XLINK_EVENT_EPSIZE        EVENT_SIZE
+
+		/** The single banked control, bulk and event endpoints must fit the 176 bytes of endpoint RAM. */
+		#if (FIXED_CONTROL_ENDPOINT_SIZE + 2 * XLINK_EPSIZE + XLINK_EVENT_EPSIZE) > 176
+			#error "endpoints exceed the 176 bytes of endpoint RAM"
+		#endif
+
 	/* Type Defines: */
 		/** Type define for the device configuration descriptor structure. This must be defined in the
 		 *  application code, as the configuration descriptor contains several sub-descriptors which
@@ -16,6 +33,9 @@
 
 			// XLink Interface
 			USB_Descriptor_Interface_t            XLinkInterface;
+			USB_Descriptor_Endpoint_t             XLinkOutEndpoint;
+			USB_Descriptor_Endpoint_t             XLinkInEndpoint;
+			USB_Descriptor_Endpoint_t             XLinkEventEndpoint;
 		} USB_Descriptor_Configuration_t;
 
 		/** Enum for the device string descriptor IDs within the device. Each string descriptor should
@@ -1,5 +1,6 @@
 #include <avr/io.h>
 #include <avr/interrupt.h>
+#include <string.h>
 #include "xlink.h"
 
 static volatile uint8_t last;
@@ -8,8 +9,60 @@ static uint32_t Boot_Key ATTR_NO_INIT;
 static volatile uint32_t hs = 0;
 static volatile uint16_t elapsed = 0;
 
+static uint8_t bulk = 0; // pending CMD_BULK_SEND/RECEIVE, run from the main loop
+static uint16_t bulkSize = 0;
+static uint16_t bulkTimeout = 0;
+
+static uint8_t armed = 0; // sequence number of the wait announced by the last strobe
+
+// counters read by CMD_STATS, laid out as described in protocol.h; the
+// watchdog resets survive the reset (cleared on power-on)
+
+static struct {
+  uint32_t sent;
+  uint32_t received;
+  uint32_t packets;
+  uint16_t timeouts;
+  uint16_t resets;
+  uint32_t waits[STATS_BUCKETS];
+} stats;
+
+static uint16_t resets ATTR_NO_INIT;
+
+static bool transact = false; // pending CMD_TRANSACT, run from the main loop
+static uint8_t request[TRANSACT_MAX_REQUEST];
+static uint8_t requestSize;
+static uint8_t responseLength;
+static uint16_t transactTimeout;
+
+// bulk payloads pass through this FIFO, so that USB packets are moved
+// while the C64 is still handshaking the current byte (256 bytes, the
+// indices wrap by themselves)
+
+static uint8_t fifo[256];
+static uint8_t head, tail;
+static uint16_t fill;
+static uint16_t pending; // bytes the host has yet to send or receive
+static uint8_t sent;     // size of the last IN packet
+
 #define STROBE_DELAY() for(uint8_t i=0; i<6; i++) { __asm__ __volatile__ ("nop"); }
 
+// in loopback mode the peer is simulated: each strobe is acked at once,
+// bytes sent are dropped and bytes received come from a counter. The
+// benchmark build (SIMULATE_ACK) starts in loopback mode
+
+#ifdef SIMULATE_ACK
+static bool loopback = true;
+#else
+static bool loopback = false;
+#endif
+static uint8_t simulated = 0;
+static uint8_t generated = 0;
+
+#define ACK() (loopback ? simulated : (PINB & PIN_ACK))
+#define STROBE() { if(loopback) simulated ^= PIN_ACK; else { PORTC &= ~PIN_STROBE; STROBE_DELAY(); PORTC |= PIN_STROBE; } }
+#define DATA() (loopback ? generated++ : PIND)
+
 int main(void)
 {      
   USB_Init();
@@ -20,12 +73,23 @@ int main(void)
 
   for(;;) {
     USB_USBTask();
+    Bulk();
+    Transact();
+    Watch();
     wdt_reset();
   }
 }
 
 void SetupHardware() {
 
+  if(MCUSR & ((1 << PORF) | (1 << BORF))) {
+    resets = 0;
+  }
+  else if(MCUSR & (1 << WDRF)) {
+    resets++;
+  }
+  MCUSR = 0;
+  
   wdt_enable(WDTO_1S);
   clock_prescale_set(clock_div_1);
 
@@ -41,6 +105,12 @@ void SetupHardware() {
   Input();
 }
 
+void EVENT_USB_Device_ConfigurationChanged(void) {
+  Endpoint_ConfigureEndpoint(XLINK_OUT_EPADDR, EP_TYPE_BULK, XLINK_EPSIZE, 1);
+  Endpoint_ConfigureEndpoint(XLINK_IN_EPADDR, EP_TYPE_BULK, XLINK_EPSIZE, 1);
+  Endpoint_ConfigureEndpoint(XLINK_EVENT_EPADDR, EP_TYPE_INTERRUPT, XLINK_EVENT_EPSIZE, 1);
+}
+
 void EVENT_USB_Device_ControlRequest(void) {
 
   if (((USB_ControlRequest.bmRequestType & CONTROL_REQTYPE_TYPE) == REQTYPE_VENDOR) &&
@@ -50,11 +120,14 @@ void EVENT_USB_Device_ControlRequest(void) {
     uint16_t timeout = (uint16_t) (USB_ControlRequest.wIndex);
     uint16_t size = USB_ControlRequest.wLength;    
 
+    armed = 0; // any other request ends an announced wait
+
     switch(USB_ControlRequest.bRequest) {
 
     case CMD_RESET:   Reset();                break;
-    case CMD_STROBE:  Strobe();               break;
+    case CMD_STROBE:  Strobe(byte);           break;
     case CMD_ACKED:   Acked();                break;
+    case CMD_WAIT:    Wait(timeout);          break;
     case CMD_INPUT:   Input();                break;
     case CMD_OUTPUT:  Output();               break;
     case CMD_READ:    Read();                 break;
@@ -62,6 +135,15 @@ void EVENT_USB_Device_ControlRequest(void) {
     case CMD_SEND:    Send(size, timeout);    break;
     case CMD_RECEIVE: Receive(size, timeout); break;
     case CMD_BOOT:    Boot();                 break;
+    case CMD_LOOPBACK: Loopback(byte);        break;
+    case CMD_STATS:   Stats(byte);            break;
+
+    case CMD_BULK_SEND:
+    case CMD_BULK_RECEIVE:
+      Prepare(USB_ControlRequest.bRequest, USB_ControlRequest.wValue, timeout);
+      break;
+
+    case CMD_TRANSACT: Accept(size, byte, timeout); break;
     }
   }
 }
@@ -108,7 +190,7 @@ void SetupACK() {
 }
 
 void ReadACK() { 
-  last = PINB & PIN_ACK; // remember last ack value
+  last = ACK(); // remember last ack value
 }
 
 void TristateRESET() {
@@ -121,6 +203,36 @@ void AssertRESET() {
   PORTC &= ~PIN_RESET; // pull reset low
 }
 
+static inline void Handshaken(void) {
+
+  // file the time the handshake just completed took (TIMER1 was reset
+  // before it) into the wait histogram
+  
+  uint16_t ticks = hs ? 0xffff : TCNT1;
+  uint16_t limit = STATS_FIRST_BUCKET;
+  uint8_t bucket = 0;
+
+  while(bucket < STATS_BUCKETS-1 && ticks >= limit) {
+    bucket++;
+    limit <<= 3;
+  }
+  stats.waits[bucket]++;
+}
+
+void Stats(uint8_t clear) {
+
+  Endpoint_ClearSETUP();
+
+  stats.resets = resets;
+  Endpoint_Write_Control_Stream_LE(&stats, sizeof(stats));
+  Endpoint_ClearOUT();
+
+  if(clear) {
+    memset(&stats, 0, sizeof(stats));
+    resets = 0;
+  }
+}
+
 void Reset() {
   Endpoint_ClearSETUP();
 
@@ -130,14 +242,16 @@ void Reset() {
 
   Endpoint_ClearOUT();
   Endpoint_ClearStatusStage();
+
+  Notify(EVENT_RESET, 0);
 }
 
-void Strobe() { 
+void Strobe(uint8_t sequence) { 
   Endpoint_ClearSETUP();
 
-  PORTC &= ~PIN_STROBE;
-  STROBE_DELAY();
-  PORTC |= PIN_STROBE;
+  STROBE();
+  ResetTimer(); // events report the time since the strobe
+  armed = sequence;
 
   Endpoint_ClearOUT();
   Endpoint_ClearStatusStage();
@@ -148,7 +262,7 @@ void Acked() {
   Endpoint_ClearSETUP();
 
   uint8_t acked = 0;
-  uint8_t current = PINB & PIN_ACK;
+  uint8_t current = ACK();
 
   if(last != current) {
     acked = 1;
@@ -163,6 +277,64 @@ void Acked() {
   Endpoint_ClearOUT();
 }
 
+static inline uint32_t Ticks(void) {
+
+  // TIMER1 count since ResetTimer() (8us ticks), re-read if the timer
+  // overflowed in between
+  
+  uint32_t high;
+  uint16_t low;
+
+  do {
+    high = hs;
+    low = TCNT1;
+  } while(high != hs);
+
+  return (high << 16) | low;
+}
+
+void Wait(uint16_t timeout) {
+
+  Endpoint_ClearSETUP();
+
+  uint8_t acked = 0;
+  uint8_t current = last;
+  uint32_t limit = (uint32_t) timeout * (1000 / EVENT_TICK_US);
+
+  ResetTimer();
+  
+  while(current == last) {
+    current = ACK();
+    wdt_reset();
+
+    if(timeout > 0 && Ticks() >= limit) break;
+  }
+
+  if(current != last) {
+    acked = 1;
+    last = current;
+  }
+
+  while(!Endpoint_IsINReady());
+  Endpoint_Write_8(acked);
+  Endpoint_ClearIN();
+
+  while(!Endpoint_IsOUTReceived());
+  Endpoint_ClearOUT();
+}
+
+void Loopback(uint8_t enabled) {
+  Endpoint_ClearSETUP();
+
+  loopback = enabled;
+  generated = 0;
+  simulated = last; // no edge pending in either mode
+  ReadACK();
+
+  Endpoint_ClearOUT();
+  Endpoint_ClearStatusStage();
+}
+
 void Input() {
   Endpoint_ClearSETUP();
 
@@ -194,7 +366,7 @@ void Write(uint8_t byte) {
 void Read() {
   Endpoint_ClearSETUP();
 
-  Endpoint_Write_8(PIND);
+  Endpoint_Write_8(DATA());
 
   Endpoint_ClearIN();
   Endpoint_ClearStatusStage();
@@ -219,26 +391,28 @@ void Send(uint16_t bytesToSend, uint16_t timeout) {
      
      PORTD = Endpoint_Read_8();
 
-     PORTC &= ~PIN_STROBE;
-     STROBE_DELAY();
-     PORTC |= PIN_STROBE;
+     STROBE();
 
      ResetTimer();
      
      while(current == last) {
-       current = PINB & PIN_ACK;
+       current = ACK();
        wdt_reset();
        
        if(timeout > 0 && elapsed >= timeout) {
+         stats.timeouts++;
          Endpoint_ClearIN(); // send data packet
          goto done;
        }
      }
      last = current;
+     Handshaken();
+     stats.sent++;
    }
    bytesToSend -= bytesInPacket;
 
    Endpoint_ClearOUT(); // ACK data packet
+   stats.packets++;
  }
  done:
  // Now ack the whole control transfer...
@@ -267,25 +441,27 @@ void Receive(uint16_t bytesToReceive, uint16_t timeout) {
      ResetTimer();
      
      while(current == last) {
-       current = PINB & PIN_ACK;
+       current = ACK();
        wdt_reset();
        
        if(timeout > 0 && elapsed >= timeout) {
+         stats.timeouts++;
          Endpoint_ClearIN(); // send data packet
          goto done;
        }
      }
      last = current;
+     Handshaken();
+     stats.received++;
 
-     Endpoint_Write_8(PIND);
+     Endpoint_Write_8(DATA());
      
-     PORTC &= ~PIN_STROBE;
-     STROBE_DELAY();
-     PORTC |= PIN_STROBE;     
+     STROBE();     
    }
    bytesToReceive -= bytesInPacket;
 
    Endpoint_ClearIN(); // send data packet
+   stats.packets++;
  }
 
  done:   
@@ -295,6 +471,328 @@ void Receive(uint16_t bytesToReceive, uint16_t timeout) {
 
 }
 
+bool Notify(uint8_t type, uint8_t sequence) {
+
+  // post an event unless the previous one is still pending
+  
+  bool posted = false;
+  
+  Endpoint_SelectEndpoint(XLINK_EVENT_EPADDR);
+
+  if(Endpoint_IsINReady()) {
+    Endpoint_Write_8(type);
+    Endpoint_Write_8(sequence);
+    Endpoint_Write_16_LE(TCNT1);
+    Endpoint_Write_16_LE((uint16_t) hs);
+    Endpoint_ClearIN();
+    posted = true;
+  }
+  Endpoint_SelectEndpoint(ENDPOINT_CONTROLEP);
+  return posted;
+}
+
+void Watch(void) {
+
+  // report the ACK edge the host announced to wait for; the edge is kept
+  // until its event could be posted
+  
+  if(!armed) return;
+
+  uint8_t current = ACK();
+
+  if(current != last && Notify(EVENT_ACK, armed)) {
+    last = current;
+    armed = 0;
+  }
+}
+
+void Prepare(uint8_t command, uint16_t size, uint16_t timeout) {
+  Endpoint_ClearSETUP();
+
+  // the payload follows on the bulk endpoint, see Bulk()
+  bulk = command;
+  bulkSize = size;
+  bulkTimeout = timeout;
+
+  Endpoint_ClearOUT();
+  Endpoint_ClearStatusStage();
+}
+
+void Bulk(void) {
+
+  uint8_t command = bulk;
+
+  if(!command) return;
+
+  bulk = 0;
+
+  if(command == CMD_BULK_SEND) {
+    BulkSend(bulkSize, bulkTimeout);
+  }
+  else {
+    BulkReceive(bulkSize, bulkTimeout);
+  }
+  Endpoint_SelectEndpoint(ENDPOINT_CONTROLEP);
+}
+
+void Accept(uint16_t size, uint8_t length, uint16_t timeout) {
+
+  if(size > sizeof(request)) return; // left unhandled, stalls the request
+  
+  Endpoint_ClearSETUP();
+  Endpoint_Read_Control_Stream_LE(request, size);
+  Endpoint_ClearIN();
+
+  // the handshakes run from the main loop, see Transact()
+  transact = true;
+  requestSize = size;
+  responseLength = length;
+  transactTimeout = timeout;
+}
+
+static inline bool Handshake(uint8_t* current, uint16_t timeout) {
+
+  ResetTimer();
+
+  while(*current == last) {
+    *current = ACK();
+    wdt_reset();
+
+    if(timeout > 0 && elapsed >= timeout) {
+      stats.timeouts++;
+      return false;
+    }
+  }
+  last = *current;
+  Handshaken();
+  return true;
+}
+
+static inline void Respond(uint8_t byte) {
+
+  Endpoint_Write_8(byte);
+
+  if(Endpoint_BytesInEndpoint() == XLINK_EPSIZE) {
+    Endpoint_ClearIN(); // send data packet
+    stats.packets++;
+    while(!Endpoint_IsINReady()) wdt_reset();
+  }
+}
+
+void Transact(void) {
+
+  uint8_t i;
+  uint8_t current = last;
+  bool complete;
+  
+  if(!transact) return;
+
+  transact = false;
+  
+  Endpoint_SelectEndpoint(XLINK_IN_EPADDR);
+  while(!Endpoint_IsINReady()) wdt_reset();
+
+  DDRD = 0xff; // PORTD as output
+  
+  for(i=0; i<requestSize; i++) {
+
+    PORTD = request[i];
+    STROBE();
+
+    if(!Handshake(&current, transactTimeout)) break;
+  }
+
+  Respond(i); // bytes sent and acked
+  complete = i == requestSize;
+  stats.sent += i;
+  
+  if(complete && responseLength) {
+
+    DDRD  = 0x00; // PORTD as input
+    PORTD = 0xff; // with pullups
+
+    STROBE();
+    
+    for(i=0; i<responseLength; i++) {
+
+      if(!Handshake(&current, transactTimeout)) break;
+
+      Respond(DATA());
+      STROBE();
+    }
+    complete = i == responseLength;
+    stats.received += i;
+  }
+  
+  DDRD  = 0x00; // leave PORTD as input
+  PORTD = 0xff;
+
+  // send the rest; if incomplete, a short or zero length packet ends
+  // the host's transfer early
+  
+  if(Endpoint_BytesInEndpoint() || !complete) {
+    Endpoint_ClearIN();
+    stats.packets++;
+  }
+  Endpoint_SelectEndpoint(ENDPOINT_CONTROLEP);
+}
+
+static inline void FifoReset(uint16_t size) {
+  head = tail = 0;
+  fill = 0;
+  sent = 0;
+  pending = size;
+}
+
+static inline void FifoPush(void) {
+
+  // take the next OUT packet if there is room for a full one
+
+  if(pending && fill <= sizeof(fifo) - XLINK_EPSIZE && Endpoint_IsOUTReceived()) {
+
+    uint8_t bytesInPacket = Endpoint_BytesInEndpoint();
+
+    if(bytesInPacket > pending) bytesInPacket = pending;
+
+    fill += bytesInPacket;
+    pending -= bytesInPacket;
+
+    while(bytesInPacket--) fifo[head++] = Endpoint_Read_8();
+
+    Endpoint_ClearOUT(); // ACK data packet, the host may send the next one
+    stats.packets++;
+  }
+}
+
+static inline void FifoPull(bool flush) {
+
+  // send the next IN packet once a full one (or the rest) is available
+
+  if(fill && (fill >= XLINK_EPSIZE || fill == pending || flush) && Endpoint_IsINReady()) {
+
+    uint8_t bytesInPacket = (fill >= XLINK_EPSIZE) ? XLINK_EPSIZE : fill;
+
+    fill -= bytesInPacket;
+    pending -= bytesInPacket;
+    sent = bytesInPacket;
+
+    while(bytesInPacket--) Endpoint_Write_8(fifo[tail++]);
+
+    Endpoint_ClearIN(); // send data packet
+    stats.packets++;
+  }
+}
+
+void BulkSend(uint16_t bytesToSend, uint16_t timeout) {
+
+ uint8_t current = last;
+
+ FifoReset(bytesToSend);
+ Endpoint_SelectEndpoint(XLINK_OUT_EPADDR);
+ 
+ while(bytesToSend) {
+
+   ResetTimer();
+   
+   while(!fill) { // Wait for data from the host
+     FifoPush();
+     wdt_reset();
+     
+     if(timeout > 0 && elapsed >= timeout) goto stall;
+   }
+
+   PORTD = fifo[tail++];
+   fill--;
+   
+   STROBE();
+
+   ResetTimer();
+     
+   while(current == last) {
+     current = ACK();
+     FifoPush(); // receive ahead while the C64 handshakes
+     wdt_reset();
+       
+     if(timeout > 0 && elapsed >= timeout) goto stall;
+   }
+   last = current;
+   Handshaken();
+   stats.sent++;
+   bytesToSend--;
+ }
+ return;
+
+ stall:
+ stats.timeouts++;
+ // fail the host's transfer, it clears the halt before the next one;
+ // the count it sees includes bytes still buffered here
+ Endpoint_StallTransaction();
+}
+
+void BulkReceive(uint16_t bytesToReceive, uint16_t timeout) {
+
+ uint8_t current = last;
+ 
+ FifoReset(bytesToReceive);
+ Endpoint_SelectEndpoint(XLINK_IN_EPADDR);
+
+ while(bytesToReceive) {
+
+   ResetTimer();
+
+   while(fill == sizeof(fifo)) { // Wait for the host to catch up
+     FifoPull(false);
+     wdt_reset();
+     
+     if(timeout > 0 && elapsed >= timeout) return;
+   }
+
+   ResetTimer();
+   
+   while(current == last) {
+     current = ACK();
+     FifoPull(false); // send ahead while the C64 handshakes
+     wdt_reset();
+       
+     if(timeout > 0 && elapsed >= timeout) {
+       stats.timeouts++;
+       goto flush;
+     }
+   }
+   last = current;
+   Handshaken();
+   stats.received++;
+
+   fifo[head++] = DATA();
+   fill++;
+
+   STROBE();
+   bytesToReceive--;
+ }
+
+ flush:
+ ResetTimer();
+ 
+ while(fill) {
+   FifoPull(true);
+   wdt_reset();
+
+   if(timeout > 0 && elapsed >= timeout) return;
+ }
+
+ // a short packet already ended the host's transfer, otherwise send a
+ // zero length packet
+ 
+ if(pending && (sent == 0 || sent == XLINK_EPSIZE)) {
+   while(!Endpoint_IsINReady()) {
+     wdt_reset();
+
+     if(timeout > 0 && elapsed >= timeout) return;
+   }
+   Endpoint_ClearIN();
+ }
+}
+
 void BootCheck(void) {
   // If the reset source was the bootloader and the key is correct, clear it and jump to the bootloader
   if ((MCUSR & (1 << WDRF)) && (Boot_Key == MAGIC_BOOT_KEY)) {
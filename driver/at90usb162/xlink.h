@@ -31,19 +31,31 @@ void TristateRESET(void);
 void AssertRESET(void);
 
 void Reset(void);
-void Strobe(void);
+void Strobe(uint8_t sequence);
 void Acked(void);
+void Wait(uint16_t timeout);
 void Input(void);
 void Output(void);
 void Read(void);
 void Write(uint8_t byte);
 void Send(uint16_t size, uint16_t timeout);
 void Receive(uint16_t size, uint16_t timeout);
+void Prepare(uint8_t command, uint16_t size, uint16_t timeout);
+void Bulk(void);
+void BulkSend(uint16_t size, uint16_t timeout);
+void BulkReceive(uint16_t size, uint16_t timeout);
+void Accept(uint16_t size, uint8_t length, uint16_t timeout);
+bool Notify(uint8_t type, uint8_t sequence);
+void Watch(void);
+void Transact(void);
 
 void BootCheck(void) ATTR_INIT_SECTION(3);
 void BootCheck(void);
 void Boot(void);
+void Loopback(uint8_t enabled);
+void Stats(uint8_t clear);
 
+void EVENT_USB_Device_ConfigurationChanged(void);
 void EVENT_USB_Device_ControlRequest(void);
 
 #endif // XLINK_H
@@ -20,6 +20,13 @@
 #include "usb.h"
 #include "shm.h"
 #include "serial.h"
+#include "sim.h"
+
+#if posix
+  #include <dirent.h>
+#elif windows
+  #include <windows.h>
+#endif
 
 extern Driver* driver;
 
@@ -88,6 +95,13 @@ bool driver_setup(char* path) {
   bool result = false;
   int type;
 
+  // release the device selected before, its driver keeps static state
+  
+  if(driver->_free != NULL) {
+    driver->_free();
+    driver->_free = NULL;
+  }
+  
   driver->path = (char *) realloc(driver->path, strlen(path)+1);
   strcpy(driver->path, path);
   
@@ -117,6 +131,9 @@ bool driver_setup(char* path) {
     driver->_reset   = &driver_parport_reset;    
     driver->_boot    = &driver_parport_boot;    
     driver->_free    = &driver_parport_free;
+    driver->_transact = NULL;
+    driver->_loopback = NULL;
+    driver->_stats    = NULL;
     
     result = driver->ready();
     
@@ -145,6 +162,9 @@ bool driver_setup(char* path) {
     driver->_reset   = &driver_usb_reset;    
     driver->_boot    = &driver_usb_boot;    
     driver->_free    = &driver_usb_free;
+    driver->_transact = &driver_usb_transact;
+    driver->_loopback = &driver_usb_loopback;
+    driver->_stats    = &driver_usb_stats;
     
     result = driver->ready();
     
@@ -173,6 +193,9 @@ bool driver_setup(char* path) {
     driver->_reset   = &driver_shm_reset;    
     driver->_boot    = &driver_shm_boot;    
     driver->_free    = &driver_shm_free;
+    driver->_transact = NULL;
+    driver->_loopback = NULL;
+    driver->_stats    = NULL;
     
     result = driver->ready();
     
@@ -183,6 +206,30 @@ bool driver_setup(char* path) {
       SET_ERROR(XLINK_ERROR_DEVICE, "failed to initialize shm device \"%s\"", driver->path);
     }
 
+  } else if(device_is_sim(type)) {
+    
+    logger->debug("using simulated adapter \"%s\"",  driver->path);
+
+    driver->_open    = &driver_sim_open;
+    driver->_close   = &driver_sim_close;    
+    driver->_strobe  = &driver_sim_strobe;    
+    driver->_wait    = &driver_sim_wait;
+    driver->_read    = &driver_sim_read;    
+    driver->_write   = &driver_sim_write;    
+    driver->_send    = &driver_sim_send;    
+    driver->_receive = &driver_sim_receive;    
+    driver->_input   = &driver_sim_input;    
+    driver->_output  = &driver_sim_output;    
+    driver->_ping    = &driver_sim_ping;    
+    driver->_reset   = &driver_sim_reset;    
+    driver->_boot    = &driver_sim_boot;    
+    driver->_free    = &driver_sim_free;
+    driver->_transact = NULL;
+    driver->_loopback = &driver_sim_loopback;
+    driver->_stats    = &driver_sim_stats;
+    
+    result = driver->ready();
+
   } else if(device_is_serial(type)) {
     
     logger->debug("trying to use serial device \"%s\"...",  driver->path);
@@ -201,6 +248,9 @@ bool driver_setup(char* path) {
     driver->_reset   = &driver_serial_reset;    
     driver->_boot    = &driver_serial_boot;    
     driver->_free    = &driver_serial_free;
+    driver->_transact = NULL;
+    driver->_loopback = NULL;
+    driver->_stats    = NULL;
     
     result = driver->ready();
     
@@ -226,9 +276,19 @@ bool device_identify(char* path, int* type) {
     return true;
   }
 
+  if(strcmp(path, "sim") == 0) {
+    (*type) = XLINK_DRIVER_DEVICE_SIM;
+    return true;
+  }
+
 #if linux
   struct stat device;
 
+  if(strncmp(path, "usb", 3) == 0) {
+    (*type) = XLINK_DRIVER_DEVICE_USB;
+    return true;
+  }
+  
   if(stat(path, &device) == -1) {
 
     SET_ERROR(XLINK_ERROR_DEVICE, "%s: couldn't stat: %s", path, strerror(errno));
@@ -292,12 +352,75 @@ bool device_identify(char* path, int* type) {
 
 //------------------------------------------------------------------------------
 
+static void device_add(xlink_device_t* devices, int max, int* count,
+                       const char* type, const char* path) {
+  if(*count < max) {
+    xlink_device_t* entry = &devices[(*count)++];
+    memset(entry, 0, sizeof(xlink_device_t));
+    strncpy(entry->type, type, sizeof(entry->type)-1);
+    strncpy(entry->path, path, sizeof(entry->path)-1);
+    entry->bus = entry->address = -1;
+  }
+}
+
+int device_enumerate(xlink_device_t* devices, int max) {
+
+  char path[256];
+  int count = driver_usb_enumerate(devices, max);
+  
+#if posix
+  DIR* dir;
+  struct dirent* file;
+  struct stat device;
+
+  // serial and parallel ports are told apart by their major number
+  
+  if((dir = opendir("/dev")) != NULL) {
+    while((file = readdir(dir)) != NULL) {
+
+      snprintf(path, sizeof(path), "/dev/%s", file->d_name);
+
+      if(stat(path, &device) == -1 || !S_ISCHR(device.st_mode)) {
+        continue;
+      }
+
+      if(device_is_serial(major(device.st_rdev))) {
+        device_add(devices, max, &count, "serial", path);
+      }
+      else if(device_is_parport(major(device.st_rdev))) {
+        device_add(devices, max, &count, "parport", path);
+      }
+    }
+    closedir(dir);
+  }
+  
+#elif windows
+  char target[256];
+  
+  for(int i=1; i<=64; i++) {
+    snprintf(path, sizeof(path), "COM%d", i);
+
+    if(QueryDosDevice(path, target, sizeof(target)) != 0) {
+      device_add(devices, max, &count, "serial", path);
+    }
+  }
+#endif
+
+  if(driver_shm_exists()) {
+    device_add(devices, max, &count, "shm", "shm");
+  }
+  return count;
+}
+
+//------------------------------------------------------------------------------
+
 bool device_is_supported(char *path, int type) {
 #if linux
 
   if(!(device_is_parport(type) ||
        device_is_usb(type) ||       
        device_is_shm(type) ||
+       device_is_sim(type) ||
        device_is_serial(type))) {
 
     SET_ERROR(XLINK_ERROR_DEVICE, 
@@ -335,6 +458,12 @@ bool device_is_serial(int type) {
 
 //------------------------------------------------------------------------------
 
+bool device_is_sim(int type) {
+  return type == XLINK_DRIVER_DEVICE_SIM;
+}
+
+//------------------------------------------------------------------------------
+
 bool _driver_ready() {
   bool result = false;
   
@@ -364,6 +493,64 @@ void _driver_reset()                                { driver->_reset(); }
 
 //------------------------------------------------------------------------------
 
+bool _driver_transact(bool ping, unsigned char* request, int size,
+                      unsigned char* response, int length) {
+
+  if(driver->_transact != NULL) {
+    return driver->_transact(ping, request, size, response, length);
+  }
+  return driver_transact(ping, request, size, response, length);
+}
+
+//------------------------------------------------------------------------------
+
+bool _driver_loopback(bool enabled) {
+
+  if(driver->_loopback == NULL) {
+    SET_ERROR(XLINK_ERROR_DEVICE, "device \"%s\" has no loopback mode", driver->path);
+    return false;
+  }
+  return driver->_loopback(enabled);
+}
+
+//------------------------------------------------------------------------------
+
+bool _driver_stats(xlink_stats_t* stats, bool clear) {
+
+  if(driver->_stats == NULL) {
+    SET_ERROR(XLINK_ERROR_DEVICE, "device \"%s\" keeps no counters", driver->path);
+    return false;
+  }
+  return driver->_stats(stats, clear);
+}
+
+//------------------------------------------------------------------------------
+
+bool driver_transact(bool ping, unsigned char* request, int size,
+                     unsigned char* response, int length) {
+
+  // ping the server, send the request and receive the response, the
+  // usual sequence for short commands, executed step by step
+  
+  if(ping && !driver->ping()) {
+    SET_ERROR(XLINK_ERROR_SERVER, "no response from server");
+    return false;
+  }
+
+  driver->output();
+  if(!driver->send(request, size)) return false;
+
+  if(length > 0) {
+    driver->input();
+    driver->strobe();
+
+    if(!driver->receive(response, length)) return false;
+  }
+  return true;
+}
+
+//------------------------------------------------------------------------------
+
 void _driver_free() {
 
   if(driver->_free != NULL) {
@@ -4,6 +4,7 @@
 #define XLINK_DRIVER_DEVICE_USB        189
 #define XLINK_DRIVER_DEVICE_PARPORT    99
 #define XLINK_DRIVER_DEVICE_SHM        -1
+#define XLINK_DRIVER_DEVICE_SIM        -2
 
 #if mac
   #define XLINK_DRIVER_DEVICE_SERIAL 31
@@ -36,6 +37,9 @@ typedef struct {
   void (*_reset) (void);
   void (*_boot) (void);
   void (*_free) (void);
+  bool (*_transact) (bool, unsigned char*, int, unsigned char*, int);
+  bool (*_loopback) (bool);
+  bool (*_stats) (xlink_stats_t*, bool);
 
   bool (*ready) (void);
   bool (*open) (void);
@@ -52,6 +56,9 @@ typedef struct {
   void (*reset) (void);
   void (*boot) (void);
   void (*free) (void);
+  bool (*transact) (bool, unsigned char*, int, unsigned char*, int);
+  bool (*loopback) (bool);
+  bool (*stats) (xlink_stats_t*, bool);
 } Driver;
 
 typedef struct {
@@ -60,12 +67,15 @@ typedef struct {
 } Transfer;
 
 bool driver_setup(char*);
+bool driver_transact(bool, unsigned char*, int, unsigned char*, int);
 bool device_identify(char*, int*); 
+int device_enumerate(xlink_device_t*, int);
 bool device_is_supported(char*, int);
 bool device_is_parport(int);
 bool device_is_usb(int);
 bool device_is_shm(int);
 bool device_is_serial(int);
+bool device_is_sim(int);
 
 bool _driver_setup_and_open(void);
 bool _driver_ready(void);
@@ -83,5 +93,8 @@ bool _driver_ping(void);
 void _driver_reset(void);
 void _driver_boot(void);
 void _driver_free();
+bool _driver_transact(bool, unsigned char*, int, unsigned char*, int);
+bool _driver_loopback(bool);
+bool _driver_stats(xlink_stats_t*, bool);
 
 #endif // DRIVER_H
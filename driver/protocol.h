@@ -11,5 +11,75 @@
 #define CMD_SEND     0x08
 #define CMD_RECEIVE  0x09
 #define CMD_BOOT     0x0a
+#define CMD_BULK_SEND    0x0b
+#define CMD_BULK_RECEIVE 0x0c
+#define CMD_TRANSACT     0x0d
+#define CMD_WAIT         0x0e
+#define CMD_LOOPBACK     0x0f
+#define CMD_STATS        0x10
+
+// bulk endpoints for CMD_BULK_SEND/RECEIVE payloads (at90usb162)
+
+#define BULK_OUT_ENDPOINT  0x01
+#define BULK_IN_ENDPOINT   0x82
+#define BULK_ENDPOINT_SIZE 32     // control, bulk and event endpoints share 176 bytes,
+                                  // checked in at90usb162/descriptors.h
+#define BULK_RELEASE       0x0110 // first firmware release (bcdDevice) with bulk endpoints
+
+// CMD_TRANSACT: the data stage holds the bytes to send, each strobed and
+// acked, wValue the number of bytes to receive afterwards (after
+// switching to input and strobing once). The result is read from the
+// bulk IN endpoint: the number of bytes sent followed by the bytes
+// received, shorter if the C64 timed out.
+
+#define TRANSACT_RELEASE      0x0120
+#define TRANSACT_MAX_REQUEST  64
+#define TRANSACT_MAX_RESPONSE 255
+
+// interrupt endpoint reporting events instead of CMD_ACKED polling: a
+// CMD_STROBE with a nonzero sequence number in wValue announces a wait,
+// the next ACK edge is then reported as type, sequence number and the
+// 32 bit TIMER1 count since the strobe (8us ticks)
+
+#define EVENT_ENDPOINT  0x83
+#define EVENT_SIZE      8
+#define EVENT_ACK       0x01 // ACK edge
+#define EVENT_RESET     0x02 // reset line released after CMD_RESET
+#define EVENT_RELEASE   0x0130
+#define EVENT_TICK_US   8
+
+// CMD_WAIT blocks in the firmware until the next ACK edge or until the
+// timeout (ms, wIndex on USB, arg1 on serial) has passed, and replies
+// once: 1 or 0 on USB, 0x55 or 0xaa on serial. The host splits longer
+// waits into slices so a lost adapter never blocks it for good. Serial
+// adapters have no version to check, CMD_ACKED with ACKED_PROBE as
+// argument is answered with WAIT_SUPPORTED instead, leaving the edge.
+
+#define WAIT_RELEASE    0x0140
+#define WAIT_SLICE      1000
+#define ACKED_PROBE     0x01
+#define WAIT_SUPPORTED  0xa5
+
+// CMD_LOOPBACK with wValue 1 makes the firmware simulate the peer: strobes
+// are acked immediately, data sent is dropped and data received counts
+// up from 0 (re-armed on each CMD_LOOPBACK). wValue 0 returns to normal
+
+#define LOOPBACK_RELEASE 0x0150
+
+// CMD_STATS returns the firmware counters (little endian), wValue 1
+// clears them afterwards:
+//
+//   0 bytes sent to the C64 (32 bit)
+//   4 bytes received from the C64 (32 bit)
+//   8 USB data packets moved (32 bit)
+//  12 handshakes that timed out (16 bit)
+//  14 watchdog resets since power-on (16 bit)
+//  16 handshakes by time waited for ACK (STATS_BUCKETS x 32 bit): less
+//     than 16us, 128us, 1ms, 8ms, 65ms and longer (TIMER1 ticks are 8us)
+
+#define STATS_RELEASE      0x0160
+#define STATS_BUCKETS      6
+#define STATS_FIRST_BUCKET 2 // TIMER1 ticks, each further bucket spans 8 times more
+#define STATS_SIZE         (16+STATS_BUCKETS*4)
 
 #endif // PROTOCOL_H
@@ -30,19 +30,38 @@
   static HANDLE hSerial;
 #endif
 
+#define SERIAL_TIMEOUT 3000 // ms without a byte before a read gives up
+
 extern Driver* driver;
 static bool initialized = false;
+static bool waitable = false; // the firmware blocks on CMD_WAIT itself
+static bool pending = false;  // ACK edge consumed by the probe of older firmware
 
 //------------------------------------------------------------------------------
 
-static void serial_read(uchar* data, int size) {
+static bool serial_read(uchar* data, int size) {
 
   logger->debug("Serial read %d bytes", size);
+
+  // each read returns after the port's own timeout, so a device that
+  // does not answer, such as a port without an adapter, fails here
+  
+  Watch* watch = watch_new();
+  bool result = true;
   
 #if posix
   int bytesRead = 0;
+  int count;
+  
   while(size > bytesRead) {
-    bytesRead += read(driver->device, data+bytesRead, size-bytesRead);
+    if((count = read(driver->device, data+bytesRead, size-bytesRead)) > 0) {
+      bytesRead += count;
+      watch_start(watch);
+    }
+    else if(watch_elapsed(watch) >= SERIAL_TIMEOUT) {
+      result = false;
+      break;
+    }
   }
   
 #elif windows
@@ -50,10 +69,26 @@ static void serial_read(uchar* data, int size) {
   DWORD bytesRead = 0;
 
   while(size > bytesReadTotal) {
+    bytesRead = 0;
     ReadFile(hSerial, data+bytesReadTotal, size-bytesReadTotal, &bytesRead, NULL);
-    bytesReadTotal += bytesRead;
+
+    if(bytesRead > 0) {
+      bytesReadTotal += bytesRead;
+      watch_start(watch);
+    }
+    else if(watch_elapsed(watch) >= SERIAL_TIMEOUT) {
+      result = false;
+      break;
+    }
   }  
 #endif
+
+  watch_free(watch);
+
+  if(!result) {
+    SET_ERROR(XLINK_ERROR_SERIAL, "no response from serial device \"%s\"", driver->path);
+  }
+  return result;
 }
 
 //------------------------------------------------------------------------------
@@ -98,6 +133,27 @@ static bool cmd(uchar cmd, uint arg1, uint arg2) {
 
 //------------------------------------------------------------------------------
 
+static bool probe(void) {
+
+  // firmware without CMD_WAIT answers the probe like a plain CMD_ACKED,
+  // an edge reported that way is kept for the next wait
+
+  uchar response[1] = { 0 };
+  cmd(CMD_ACKED, ACKED_PROBE, 0);
+
+  if(!serial_read(response, 1)) {
+    return false;
+  }
+
+  waitable = response[0] == WAIT_SUPPORTED;
+  pending = response[0] == 0x55;
+
+  logger->debug("serial firmware %s CMD_WAIT", waitable ? "supports" : "lacks");
+  return true;
+}
+
+//------------------------------------------------------------------------------
+
 bool driver_serial_open(void) {
   bool result = false;
 
@@ -150,6 +206,11 @@ bool driver_serial_open(void) {
        
 #endif
     initialized = true;
+
+    if(!probe()) {
+      driver_serial_free();
+      goto done;
+    }
   }
   
   driver->input();
@@ -191,14 +252,48 @@ void driver_serial_strobe(void) {
 static bool acked(void) {
   uchar response[1] = { 0 };
   cmd(CMD_ACKED, 0, 0);
-  serial_read(response, 1);
-  return response[0] == 0x55;
+  return serial_read(response, 1) && response[0] == 0x55;
+}
+
+static bool firmware_acked(int timeout) {
+
+  bool forever = timeout <= 0;
+  uchar response[1] = { 0 };
+  int slice;
+
+  // one command per slice, each answered as soon as the edge arrives
+  
+  while(forever || timeout > 0) {
+
+    slice = (forever || timeout > WAIT_SLICE) ? WAIT_SLICE : timeout;
+
+    cmd(CMD_WAIT, slice, 0);
+
+    if(!serial_read(response, 1)) {
+      return false;
+    }
+
+    if(response[0] == 0x55) {
+      return true;
+    }
+    timeout -= slice;
+  }
+  return false;
 }
 
 bool driver_serial_wait(int timeout) {
   
   bool result = false;
 
+  if(pending) {
+    pending = false;
+    return true;
+  }
+
+  if(waitable) {
+    return firmware_acked(timeout);
+  }
+
   if(timeout <= 0) {
     while(!acked());
     result = true;
@@ -230,11 +325,14 @@ void driver_serial_write(unsigned char value) {
 //------------------------------------------------------------------------------
 
 bool driver_serial_send(unsigned char* data, int size) {
-  unsigned int bytesSent;
+  unsigned int bytesSent = 0;
   
   cmd(CMD_SEND, size, 2);
   serial_write(data, size);
-  serial_read((uchar*) &bytesSent, 4);
+
+  if(!serial_read((uchar*) &bytesSent, 4)) {
+    return false;
+  }
 
   bool result = bytesSent == size;
   
@@ -249,11 +347,13 @@ bool driver_serial_send(unsigned char* data, int size) {
 //------------------------------------------------------------------------------
 
 bool driver_serial_receive(unsigned char* data, int size) { 
-  unsigned int bytesReceived;
+  unsigned int bytesReceived = 0;
 
   cmd(CMD_RECEIVE, size, 2);
-  serial_read(data, size);
-  serial_read((uchar*) &bytesReceived, 4);
+
+  if(!serial_read(data, size) || !serial_read((uchar*) &bytesReceived, 4)) {
+    return false;
+  }
 
   bool result = bytesReceived == size;
   
@@ -285,11 +385,19 @@ void driver_serial_reset(void) {
 //------------------------------------------------------------------------------
 
 void driver_serial_free(void) {
+
+  if(!initialized) {
+    return;
+  }
+  
 #if posix
   close(driver->device);
 #elif windows
   CloseHandle(hSerial);
 #endif
+
+  initialized = false;
+  waitable = pending = false;
 }
 
 //------------------------------------------------------------------------------
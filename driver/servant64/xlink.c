@@ -72,7 +72,8 @@ int main(void) {
 
     case CMD_RESET:   Reset();                break;
     case CMD_STROBE:  Strobe();               break;
-    case CMD_ACKED:   Acked();                break;
+    case CMD_ACKED:   Acked(byte);            break;
+    case CMD_WAIT:    Wait(size);             break;
     case CMD_INPUT:   Input();                break;
     case CMD_OUTPUT:  Output();               break;
     case CMD_READ:    WriteSerial(Read());    break;
@@ -228,11 +229,16 @@ void Strobe() {
 
 //------------------------------------------------------------------------------
 
-void Acked() {
+void Acked(uint8_t probe) {
 
   uint8_t acked = 0xaa;
   uint8_t current = PIND & PIN_ACK;
 
+  if(probe == ACKED_PROBE) {
+    WriteSerial(WAIT_SUPPORTED); // the edge is left for the next wait
+    return;
+  }
+
   if(last != current) {
     acked = 0x55;
     last = current;
@@ -242,6 +248,48 @@ void Acked() {
 
 //------------------------------------------------------------------------------
 
+static inline uint32_t Ticks(void) {
+
+  // TIMER1 count since ResetTimer() (4us ticks), re-read if the timer
+  // overflowed in between
+
+  uint32_t high;
+  uint16_t low;
+
+  do {
+    high = qs;
+    low = TCNT1;
+  } while(high != qs);
+
+  return (high << 16) | low;
+}
+
+//------------------------------------------------------------------------------
+
+void Wait(uint32_t timeout) {
+
+  uint8_t acked = 0xaa;
+  uint8_t current = last;
+  uint32_t limit = timeout * (F_CPU / 64 / 1000);
+
+  ResetTimer();
+
+  while(current == last) {
+    current = PIND & PIN_ACK;
+    wdt_reset();
+
+    if(timeout > 0 && Ticks() >= limit) break;
+  }
+
+  if(current != last) {
+    acked = 0x55;
+    last = current;
+  }
+  WriteSerial(acked);
+}
+
+//------------------------------------------------------------------------------
+
 uint8_t Read(void) {
   uint8_t byte = 0;
 
@@ -24,7 +24,8 @@ void Input(void);
 void Output(void);
 
 void Strobe(void);
-void Acked(void);
+void Acked(uint8_t probe);
+void Wait(uint32_t timeout);
 
 uint8_t Read(void);
 void Write(uint8_t);
@@ -247,9 +247,28 @@ void driver_shm_free(void) {
 #elif windows
     UnmapViewOfFile(port);
 #endif
+    initialized = false;
 }
 
 //------------------------------------------------------------------------------
 
 void driver_shm_close(void) { /* nothing to close */ }
 void driver_shm_boot(void) { /* nothing to boot */ };
+
+//------------------------------------------------------------------------------
+
+bool driver_shm_exists(void) {
+#if posix
+  return access(shmname, F_OK) == 0;
+#elif windows
+  HANDLE mapping = OpenFileMapping(FILE_MAP_READ, FALSE, shmname);
+
+  if(mapping != NULL) {
+    CloseHandle(mapping);
+    return true;
+  }
+  return false;
+#endif
+}
+
+//------------------------------------------------------------------------------
@@ -25,5 +25,6 @@ bool driver_shm_ping(void);
 void driver_shm_reset(void);
 void driver_shm_boot(void);
 void driver_shm_free(void);
+bool driver_shm_exists(void);
 
 #endif // SHM_H
@@ -0,0 +1,153 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "target.h"
+#include "error.h"
+#include "xlink.h"
+#include "driver.h"
+#include "sim.h"
+#include "util.h"
+
+// Software stand-in for an adapter in loopback mode (device "sim"),
+// behaving like the firmware after CMD_LOOPBACK: every strobe is acked
+// at once, bytes sent are dropped and bytes received count up from 0.
+// Lets the host side be benchmarked without any hardware.
+
+extern Driver* driver;
+
+static int direction = XLINK_DRIVER_STATE_INPUT;
+static bool acked = false;     // ACK edge pending
+static uchar generated = 0;    // next byte received
+static uchar written = 0xff;
+static xlink_stats_t counters;  // packets and resets stay 0
+
+//------------------------------------------------------------------------------
+
+bool driver_sim_open(void) {
+  driver->input();
+  return true;
+}
+
+//------------------------------------------------------------------------------
+
+void driver_sim_input(void) {
+  direction = XLINK_DRIVER_STATE_INPUT;
+}
+
+//------------------------------------------------------------------------------
+
+void driver_sim_output(void) {
+  direction = XLINK_DRIVER_STATE_OUTPUT;
+}
+
+//------------------------------------------------------------------------------
+
+void driver_sim_strobe(void) {
+  acked = true;
+}
+
+//------------------------------------------------------------------------------
+
+bool driver_sim_wait(int timeout) {
+  bool result = acked;
+  acked = false;
+  return result;
+}
+
+//------------------------------------------------------------------------------
+
+unsigned char driver_sim_read(void) {
+  return (direction == XLINK_DRIVER_STATE_INPUT) ? generated++ : written;
+}
+
+//------------------------------------------------------------------------------
+
+void driver_sim_write(unsigned char value) {
+  written = value;
+}
+
+//------------------------------------------------------------------------------
+
+bool driver_sim_send(unsigned char* data, int size) {
+
+  for(int i=0; i<size; i++) {
+    driver_sim_write(data[i]);
+    driver_sim_strobe();
+
+    if(!driver_sim_wait(0)) {
+      SET_ERROR(XLINK_ERROR_DEVICE,
+                "transfer timeout (%d of %d bytes sent)", i, size);
+      return false;
+    }
+    counters.sent++;
+    counters.waits[0]++;
+  }
+  return true;
+}
+
+//------------------------------------------------------------------------------
+
+bool driver_sim_receive(unsigned char* data, int size) { 
+
+  for(int i=0; i<size; i++) {
+    acked = true; // the simulated peer has the next byte ready
+
+    if(!driver_sim_wait(0)) {
+      SET_ERROR(XLINK_ERROR_DEVICE,
+                "transfer timeout (%d of %d bytes received)", i, size);
+      return false;
+    }
+    data[i] = driver_sim_read();
+    driver_sim_strobe();
+    counters.received++;
+    counters.waits[0]++;
+  }
+  acked = false;
+  return true;
+}
+
+//------------------------------------------------------------------------------
+
+bool driver_sim_ping(void) {
+  driver->output();
+  driver->write(XLINK_COMMAND_PING);
+  driver->strobe();
+  return driver->wait(250);
+}
+
+//------------------------------------------------------------------------------
+
+bool driver_sim_loopback(bool enabled) {
+
+  // always in loopback mode, there is no peer to switch back to
+  
+  generated = 0;
+  acked = false;
+  return true;
+}
+
+//------------------------------------------------------------------------------
+
+bool driver_sim_stats(xlink_stats_t* stats, bool clear) {
+
+  (*stats) = counters;
+
+  if(clear) {
+    memset(&counters, 0, sizeof(counters));
+  }
+  return true;
+}
+
+//------------------------------------------------------------------------------
+
+void driver_sim_reset(void) {
+  acked = false;
+}
+
+//------------------------------------------------------------------------------
+
+void driver_sim_close(void) { /* nothing to close */ }
+void driver_sim_boot(void) { /* nothing to boot */ }
+void driver_sim_free(void) { /* nothing to free */ }
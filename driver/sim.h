@@ -0,0 +1,23 @@
+#ifndef SIM_H
+#define SIM_H
+
+#include "xlink.h"
+
+bool driver_sim_open(void);
+void driver_sim_close(void);
+void driver_sim_strobe(void);
+bool driver_sim_wait(int);
+unsigned char driver_sim_read(void);
+void driver_sim_write(unsigned char);
+bool driver_sim_send(unsigned char*, int);
+bool driver_sim_receive(unsigned char*, int);
+void driver_sim_input(void);
+void driver_sim_output(void);
+bool driver_sim_ping(void);
+void driver_sim_reset(void);
+void driver_sim_boot(void);
+void driver_sim_free(void);
+bool driver_sim_loopback(bool);
+bool driver_sim_stats(xlink_stats_t*, bool);
+
+#endif // SIM_H
@@ -16,12 +16,53 @@
 #include "target.h"
 
 #define MAX_PAYLOAD_SIZE 4096
+#define MAX_BULK_PAYLOAD_SIZE 0x8000
+#define BULK_SEGMENT_SIZE 4096 // bulk payloads are queued in segments of this size
+#define DEFAULT_QUEUE_DEPTH 4  // segments in flight, XLINK_USB_QUEUE overrides it
+#define MAX_QUEUE_DEPTH 32
 
 extern Driver* driver;
 
+static libusb_context *context = NULL; // kept for the life of the process
 static libusb_device_handle *handle = NULL;
+static libusb_hotplug_callback_handle hotplug;
+static volatile bool detached = false; // the open adapter was unplugged
+static char attached[64];              // serial number of the last adapter opened
+static int attached_bus = -1;
+static int attached_address = -1;
+static bool bulk = false;
+static bool transact = false;
+static bool input = false; // data port direction known to be input
+static bool notify = false; // ACK edges can be reported on the event endpoint
+static bool waitable = false; // the firmware blocks on CMD_WAIT itself
+static unsigned char sequence = 0;
+static unsigned char armed = 0; // sequence number of the announced wait
 static unsigned char response[1];
 
+// where adapters were last found by serial number, so that opening
+// "usb:SERIAL" does not have to read the serial number of every adapter
+
+#define USB_CACHE_SIZE 8
+
+static struct {
+  char serial[64];
+  int bus;
+  int address;
+  int age;
+} cache[USB_CACHE_SIZE];
+
+static int cache_age = 0;
+
+// an entry of the transfer queue: either the announcement of the next
+// chunk (CMD_BULK_SEND/RECEIVE) or a segment of its payload
+
+typedef struct {
+  struct libusb_transfer* transfer;
+  unsigned char setup[LIBUSB_CONTROL_SETUP_SIZE];
+  int length; // segment size, 0 for an announcement
+  int done;
+} Slot;
+
 //------------------------------------------------------------------------------
 // USB device discovery
 //------------------------------------------------------------------------------
@@ -33,6 +74,17 @@ void driver_usb_lookup(char *path, DeviceInfo *info) {
   info->bus     = -1;
   info->address = -1;
   info->serial  = NULL;
+
+  // "usb" for the first adapter found or "usb:SERIAL" for a specific one
+  
+  if(strncmp(path, "usb", 3) == 0) {
+
+    char *colon;
+    if((colon = strstr(path, ":")) != NULL && strlen(colon+1) > 0) {
+      info->serial = colon+1;
+    }
+    return;
+  }
   
 #if linux
 
@@ -42,6 +94,10 @@ void driver_usb_lookup(char *path, DeviceInfo *info) {
   char* address;
   
   char prefix[] = "/dev/bus/usb/";
+
+  if(real == NULL) {
+    return;
+  }
   
   if(strstr(real, prefix) == real) {
 
@@ -56,19 +112,50 @@ void driver_usb_lookup(char *path, DeviceInfo *info) {
   }
   
   free(real);
+#endif
+}
+
+//------------------------------------------------------------------------------
 
-#elif windows
+static bool cached(char* serial, int* bus, int* address) {
 
-  char *colon;
-  if((colon = strstr(path, ":")) != NULL) {
-    info->serial = colon+1;
+  for(int i=0; i<USB_CACHE_SIZE; i++) {
+    if(cache[i].bus > 0 && strcmp(cache[i].serial, serial) == 0) {
+      (*bus) = cache[i].bus;
+      (*address) = cache[i].address;
+      return true;
+    }
   }
-#endif
+  return false;
+}
+
+static void remember(char* serial, int bus, int address) {
+
+  int slot = 0;
+
+  // replace the entry for serial or one for the same bus and address
+  // (the adapter there was replugged), otherwise the oldest
+
+  for(int i=0; i<USB_CACHE_SIZE; i++) {
+    if(strcmp(cache[i].serial, serial) == 0 ||
+       (cache[i].bus == bus && cache[i].address == address)) {
+      slot = i;
+      break;
+    }
+    if(cache[i].age < cache[slot].age) {
+      slot = i;
+    }
+  }
+
+  strncpy(cache[slot].serial, serial, sizeof(cache[slot].serial)-1);
+  cache[slot].bus = bus;
+  cache[slot].address = address;
+  cache[slot].age = ++cache_age;
 }
 
 //------------------------------------------------------------------------------
 
-libusb_device_handle* driver_usb_open_device(libusb_context* context, DeviceInfo *info) {
+static libusb_device_handle* find_device(libusb_context* context, DeviceInfo *info) {
 
   libusb_device **devices;
   libusb_device *device;
@@ -106,6 +193,10 @@ libusb_device_handle* driver_usb_open_device(libusb_context* context, DeviceInfo
         }
       }
       
+      if(info->serial != NULL && descriptor.iSerialNumber == 0) {
+        continue; // cannot be the adapter asked for
+      }
+      
       if(info->serial != NULL) {
         
         if(descriptor.iSerialNumber != 0) {
@@ -126,6 +217,7 @@ libusb_device_handle* driver_usb_open_device(libusb_context* context, DeviceInfo
           }
           
           if(strcmp(serial, info->serial) == 0) {
+            remember(serial, libusb_get_bus_number(device), libusb_get_device_address(device));
             goto done;
           }
           
@@ -157,6 +249,177 @@ libusb_device_handle* driver_usb_open_device(libusb_context* context, DeviceInfo
   return handle;
 }
 
+libusb_device_handle* driver_usb_open_device(libusb_context* context, DeviceInfo *info) {
+
+  DeviceInfo hint = *info;
+  libusb_device_handle* handle;
+
+  // try where the serial number was last seen before reading the serial
+  // numbers of all adapters
+
+  if(info->serial != NULL && info->bus == -1 &&
+     cached(info->serial, &hint.bus, &hint.address)) {
+
+    logger->suspend();
+    handle = find_device(context, &hint);
+    logger->resume();
+
+    if(handle != NULL) {
+      return handle;
+    }
+  }
+  return find_device(context, info);
+}
+
+//------------------------------------------------------------------------------
+
+int driver_usb_enumerate(xlink_device_t* devices, int max) {
+
+  libusb_device **list;
+  libusb_device *device;
+  libusb_device_handle *handle;
+  struct libusb_device_descriptor descriptor;
+  xlink_device_t *entry;
+  int count = 0;
+  int i = 0;
+
+  if(!driver_usb_setup()) {
+    return 0;
+  }
+
+  if(libusb_get_device_list(context, &list) < 0) {
+    return 0;
+  }
+  
+  while ((device = list[i++]) != NULL && count < max) {
+
+    if(libusb_get_device_descriptor(device, &descriptor) < 0 ||
+       descriptor.idVendor != 0x1d50 || descriptor.idProduct != 0x60c8) {
+      continue;
+    }
+
+    entry = &devices[count++];
+    memset(entry, 0, sizeof(xlink_device_t));
+    
+    strcpy(entry->type, "usb");
+    entry->bus = libusb_get_bus_number(device);
+    entry->address = libusb_get_device_address(device);
+    entry->firmware = descriptor.bcdDevice;
+
+    if(descriptor.iSerialNumber != 0 && libusb_open(device, &handle) == 0) {
+      if(libusb_get_string_descriptor_ascii(handle, descriptor.iSerialNumber,
+                                            (unsigned char*) entry->serial,
+                                            sizeof(entry->serial)) < 0) {
+        entry->serial[0] = '\0';
+      }
+      libusb_close(handle);
+    }
+
+    if(strlen(entry->serial)) {
+      remember(entry->serial, entry->bus, entry->address);
+      snprintf(entry->path, sizeof(entry->path), "usb:%s", entry->serial);
+    }
+    else {
+#if linux
+      snprintf(entry->path, sizeof(entry->path), "/dev/bus/usb/%03d/%03d",
+               entry->bus, entry->address);
+#else
+      strcpy(entry->path, "usb");
+#endif
+    }
+  }
+
+  libusb_free_device_list(list, true);
+  return count;
+}
+
+static int LIBUSB_CALL hotplugged(libusb_context* context, libusb_device* device,
+                                  libusb_hotplug_event event, void* data) {
+
+  // only note the event, requests must not be made from here
+  
+  if(event == LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT) {
+
+    if(handle != NULL && libusb_get_device(handle) == device) {
+      logger->debug("adapter %s disconnected", attached);
+      detached = true;
+    }
+  }
+  else {
+    logger->debug("adapter connected at %03d/%03d",
+                  libusb_get_bus_number(device),
+                  libusb_get_device_address(device));
+  }
+  return 0;
+}
+
+bool driver_usb_setup() {
+
+  int result;
+
+  if(context != NULL) {
+    return true;
+  }
+  
+  if((result = libusb_init(&context)) < 0) {
+    SET_ERROR(XLINK_ERROR_LIBUSB, "could not initialize libusb-1.0: %d", result);
+    context = NULL;
+    return false;
+  }
+
+  if(libusb_has_capability(LIBUSB_CAP_HAS_HOTPLUG)) {
+    libusb_hotplug_register_callback(context,
+                                     LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED |
+                                     LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT,
+                                     LIBUSB_HOTPLUG_NO_FLAGS, 0x1d50, 0x60c8,
+                                     LIBUSB_HOTPLUG_MATCH_ANY, hotplugged, NULL, &hotplug);
+  }
+  return true;
+}
+
+//------------------------------------------------------------------------------
+
+static int checked(int result) {
+  if(result == LIBUSB_ERROR_NO_DEVICE) {
+    detached = true;
+  }
+  return result;
+}
+
+static void pump(void) {
+
+  // let libusb report hotplug events while no transfer is running
+  
+  struct timeval none = { 0, 0 };
+  libusb_handle_events_timeout(context, &none);
+}
+
+//------------------------------------------------------------------------------
+
+static void remember_attached(void) {
+
+  libusb_device* device = libusb_get_device(handle);
+  struct libusb_device_descriptor descriptor;
+
+  int bus = libusb_get_bus_number(device);
+  int address = libusb_get_device_address(device);
+  
+  if(bus == attached_bus && address == attached_address) {
+    return;
+  }
+
+  attached_bus = bus;
+  attached_address = address;
+  attached[0] = '\0';
+  
+  if(libusb_get_device_descriptor(device, &descriptor) == 0 && descriptor.iSerialNumber != 0) {
+    if(libusb_get_string_descriptor_ascii(handle, descriptor.iSerialNumber,
+                                          (unsigned char*) attached, sizeof(attached)) < 0) {
+      attached[0] = '\0';
+    }
+  }
+}
+
 //------------------------------------------------------------------------------
 // USB driver implementation
 //------------------------------------------------------------------------------
@@ -164,25 +427,60 @@ libusb_device_handle* driver_usb_open_device(libusb_context* context, DeviceInfo
 bool driver_usb_open() {
 
   DeviceInfo info;
-  int result;
 
-  if((result = libusb_init(NULL)) < 0) {
-    SET_ERROR(XLINK_ERROR_LIBUSB, "could not initialize libusb-1.0: %d", result);
+  if(!driver_usb_setup()) {
     return false;
   }
+
+  pump();
+  detached = false;
   
   driver_usb_lookup(driver->path, &info);
+
+  if(strncmp(driver->path, "usb", 3) != 0 && info.bus == -1 && attached_bus != -1) {
+
+    // the device node of the adapter used before is gone after a replug,
+    // only that adapter may take its place, not any other one
+    
+    info.serial = attached;
+
+    if(!strlen(attached) || (handle = driver_usb_open_device(context, &info)) == NULL) {
+      SET_ERROR(XLINK_ERROR_LIBUSB, "adapter used with \"%s\" is no longer connected",
+                driver->path);
+      return false;
+    }
+    logger->debug("reattached adapter %s", attached);
+  }
+  else {
+    handle = driver_usb_open_device(context, &info);
+  }
   
-  handle = driver_usb_open_device(NULL, &info);
+  if(handle == NULL && info.serial == NULL && strlen(attached)) {
 
+    // the adapter used before was replugged and got a new address
+    
+    info.bus = info.address = -1;
+    info.serial = attached;
+    
+    if((handle = driver_usb_open_device(context, &info)) != NULL) {
+      logger->debug("reattached adapter %s", attached);
+    }
+  }
+  
   if(handle == NULL) {
     SET_ERROR(XLINK_ERROR_LIBUSB, "could not open device \"%s\"", driver->path);
-
-    libusb_exit(NULL);
     return false;
   }
 
+  remember_attached();
+
+  bulk = driver_usb_claim_bulk();
+  transact = bulk && driver_usb_release() >= TRANSACT_RELEASE;
+  notify = bulk && driver_usb_release() >= EVENT_RELEASE;
+  waitable = driver_usb_release() >= WAIT_RELEASE;
+  
   control(CMD_INPUT);
+  input = true;
 
   CLEAR_ERROR;
   return true;
@@ -190,6 +488,38 @@ bool driver_usb_open() {
 
 //------------------------------------------------------------------------------
 
+int driver_usb_release() {
+
+  struct libusb_device_descriptor descriptor;
+  
+  if(libusb_get_device_descriptor(libusb_get_device(handle), &descriptor) < 0) {
+    return 0;
+  }
+  return descriptor.bcdDevice;
+}
+
+//------------------------------------------------------------------------------
+
+bool driver_usb_claim_bulk() {
+
+  int release = driver_usb_release();
+  int result;
+  
+  if(release < BULK_RELEASE) {
+    logger->debug("firmware %x.%02x: using control transfers",
+                  release >> 8, release & 0xff);
+    return false;
+  }
+
+  if((result = libusb_claim_interface(handle, 0)) < 0) {
+    logger->debug("could not claim interface: %d, using control transfers", result);
+    return false;
+  }
+  return true;
+}
+
+//------------------------------------------------------------------------------
+
 void driver_usb_strobe() {
   control(CMD_STROBE);
 }
@@ -203,19 +533,91 @@ static bool acked(void) {
   return false;
 }
 
+static bool event_acked(int timeout, unsigned char expected) {
+
+  unsigned char event[EVENT_SIZE];
+  struct timeval start, now;
+  int elapsed = 0;
+  int transfered;
+  int result;
+
+  gettimeofday(&start, NULL);
+  
+  // block on the event endpoint until the announced ACK edge arrives or
+  // the deadline passes, other (stale) events are skipped
+
+  do {
+    result = checked(libusb_interrupt_transfer(handle, EVENT_ENDPOINT, event, sizeof(event),
+                                               &transfered, timeout > 0 ? timeout - elapsed : 0));
+
+    if(result == 0 && transfered >= 2 &&
+       event[0] == EVENT_ACK && event[1] == expected) {
+      return true;
+    }
+
+    gettimeofday(&now, NULL);
+    elapsed = (now.tv_sec - start.tv_sec) * 1000 + (now.tv_usec - start.tv_usec) / 1000;
+    
+  } while(result == 0 && (timeout <= 0 || elapsed < timeout));
+
+  return false;
+}
+
+static bool firmware_acked(int timeout) {
+
+  bool forever = timeout <= 0;
+  int slice;
+  int result;
+  
+  // one request per slice, each answered as soon as the edge arrives
+  
+  while(forever || timeout > 0) {
+
+    slice = (forever || timeout > WAIT_SLICE) ? WAIT_SLICE : timeout;
+    
+    result = checked(libusb_control_transfer(handle,
+                                             LIBUSB_REQUEST_TYPE_VENDOR |
+                                             LIBUSB_RECIPIENT_DEVICE |
+                                             LIBUSB_ENDPOINT_IN,
+                                             CMD_WAIT, 0, slice,
+                                             response, sizeof(response), slice+1000));
+    if(result < 1) {
+      return false;
+    }
+    
+    if(response[0] == 1) {
+      return true;
+    }
+    timeout -= slice;
+  }
+  return false;
+}
+
 bool driver_usb_wait(int timeout) {
+
+  if(armed) {
+    bool result = event_acked(timeout, armed);
+    armed = 0;
+    return result;
+  }
+
+  if(waitable) {
+    return firmware_acked(timeout);
+  }
   
   response[0] = 0;
 
   bool result = false;
 
   if(timeout <= 0) {
-    while(!acked());
-    result = true;
+    while(!(result = acked()) && !detached) {
+      pump();
+    }
   }
   else {
-    while(timeout && !(result = acked())) {      
+    while(timeout > 0 && !(result = acked()) && !detached) {
       usleep(10*1000);     
+      pump();
       timeout-=10;
     }
   }
@@ -237,6 +639,159 @@ unsigned char driver_usb_read() {
 
 //------------------------------------------------------------------------------
 
+static int queue_depth(void) {
+
+  int depth = DEFAULT_QUEUE_DEPTH;
+
+  if(getenv("XLINK_USB_QUEUE") != NULL) {
+    depth = strtol(getenv("XLINK_USB_QUEUE"), NULL, 10);
+  }
+  return depth < 1 ? 1 : (depth > MAX_QUEUE_DEPTH ? MAX_QUEUE_DEPTH : depth);
+}
+
+static void LIBUSB_CALL completed(struct libusb_transfer* transfer) {
+  ((Slot*) transfer->user_data)->done = 1;
+}
+
+static bool announce(Slot* slot, unsigned char command, int chunk) {
+
+  // the firmware takes the announcement once the previous chunk is
+  // through, so it is not subject to a timeout
+  
+  slot->done = 0;
+  slot->length = 0;
+  
+  libusb_fill_control_setup(slot->setup,
+                            LIBUSB_REQUEST_TYPE_VENDOR |
+                            LIBUSB_RECIPIENT_DEVICE |
+                            LIBUSB_ENDPOINT_OUT,
+                            command, chunk, driver->timeout, 0);
+  
+  libusb_fill_control_transfer(slot->transfer, handle, slot->setup,
+                               completed, slot, 0);
+  
+  return libusb_submit_transfer(slot->transfer) == 0;
+}
+
+static bool segment(Slot* slot, unsigned char endpoint, unsigned char* data, int offset, int length) {
+
+  // segments wait for those queued before them, hence the longer timeout
+  
+  slot->done = 0;
+  slot->length = length;
+  
+  libusb_fill_bulk_transfer(slot->transfer, handle, endpoint, data+offset, length,
+                            completed, slot, (driver->timeout+1)*1036*MAX_QUEUE_DEPTH);
+  
+  return libusb_submit_transfer(slot->transfer) == 0;
+}
+
+static void stream(unsigned char command, unsigned char endpoint, Transfer* transfer, int size) {
+
+  // keep up to depth transfers queued so the link never idles while the
+  // host handles a completion: each chunk of at most MAX_BULK_PAYLOAD_SIZE
+  // bytes is announced by a control request and followed by its payload
+  // in segments. Completions are taken in order, the first short or failed
+  // one ends the stream with transfer->completed at the exact offset
+  
+  Slot slots[MAX_QUEUE_DEPTH];
+  unsigned char* data = transfer->data;
+  int depth = queue_depth();
+  int head = 0, tail = 0, inflight = 0;
+  int announced = 0; // end of the chunks announced so far
+  int queued = 0;    // end of the segments queued so far
+  bool failed = false;
+  int i;
+
+  for(i=0; i<depth; i++) {
+    if((slots[i].transfer = libusb_alloc_transfer(0)) == NULL) {
+      depth = i;
+      break;
+    }
+  }
+
+  while(depth && !failed && (queued < size || inflight)) {
+
+    while(!failed && !detached && inflight < depth && queued < size) {
+
+      Slot* slot = &slots[head];
+      int chunk = size - queued > MAX_BULK_PAYLOAD_SIZE ? MAX_BULK_PAYLOAD_SIZE : size - queued;
+      int length = announced - queued > BULK_SEGMENT_SIZE ? BULK_SEGMENT_SIZE : announced - queued;
+      
+      if(queued == announced ?
+         !announce(slot, command, chunk) :
+         !segment(slot, endpoint, data, queued, length)) {
+        failed = true;
+        break;
+      }
+
+      if(queued == announced) {
+        announced += chunk;
+      }
+      else {
+        queued += length;
+      }
+      head = (head+1) % depth;
+      inflight++;
+    }
+    
+    if(!inflight) break;
+
+    Slot* slot = &slots[tail];
+
+    while(!slot->done) {
+      libusb_handle_events_completed(context, &slot->done);
+    }
+
+    struct libusb_transfer* usb = slot->transfer;
+    
+    if(usb->status != LIBUSB_TRANSFER_COMPLETED ||
+       (slot->length && usb->actual_length < slot->length)) {
+
+      if(slot->length) {
+        transfer->completed += usb->actual_length;
+      }
+      
+      if(usb->status == LIBUSB_TRANSFER_NO_DEVICE) {
+        detached = true;
+      }
+      
+      if(usb->status == LIBUSB_TRANSFER_STALL) {
+        libusb_clear_halt(handle, endpoint); // the firmware stalls on timeout
+      }
+      
+      logger->debug("usb transfer failed at offset %d: status %d",
+                    transfer->completed, usb->status);
+      failed = true;
+    }
+    else if(slot->length) {
+      transfer->completed += slot->length;
+      logger->debug("%d of %d bytes transfered", transfer->completed, size);
+    }
+    tail = (tail+1) % depth;
+    inflight--;
+  }
+
+  // cancel what is still queued after a failure and wait for it to end
+  
+  while(inflight) {
+    Slot* slot = &slots[tail];
+    libusb_cancel_transfer(slot->transfer);
+
+    while(!slot->done) {
+      libusb_handle_events_completed(context, &slot->done);
+    }
+    tail = (tail+1) % depth;
+    inflight--;
+  }
+  
+  for(i=0; i<depth; i++) {
+    libusb_free_transfer(slots[i].transfer);
+  }
+}
+
+//------------------------------------------------------------------------------
+
 static bool send_chunk(ushort chunk, void *context) {
 
   Transfer *transfer = (Transfer*) context;
@@ -262,14 +817,21 @@ bool driver_usb_send(unsigned char* data, int size) {
   Transfer transfer;
   transfer.data = data;
   transfer.completed = 0;
-  
-  chunked(send_chunk, &transfer, MAX_PAYLOAD_SIZE, size);
+
+  if(bulk) {
+    stream(CMD_BULK_SEND, BULK_OUT_ENDPOINT, &transfer, size);
+  }
+  else {
+    chunked(send_chunk, &transfer, MAX_PAYLOAD_SIZE, size);
+  }
 
   bool result = transfer.completed == size;
   
   if(!result) {
-    SET_ERROR(XLINK_ERROR_LIBUSB,
-              "transfer timeout (%d of %d bytes sent)", transfer.completed, size);
+    SET_ERROR(detached ? XLINK_ERROR_DISCONNECTED : XLINK_ERROR_LIBUSB,
+              "%s at offset $%04x (%d of %d bytes sent)",
+              detached ? "adapter disconnected" : "transfer timeout",
+              transfer.completed, transfer.completed, size);
   }
   
   CLEAR_ERROR_IF(result);
@@ -303,14 +865,21 @@ bool driver_usb_receive(unsigned char* data, int size) {
   Transfer transfer;
   transfer.data = data;
   transfer.completed = 0;
-  
-  chunked(&receive_chunk, &transfer, MAX_PAYLOAD_SIZE, size);
+
+  if(bulk) {
+    stream(CMD_BULK_RECEIVE, BULK_IN_ENDPOINT, &transfer, size);
+  }
+  else {
+    chunked(&receive_chunk, &transfer, MAX_PAYLOAD_SIZE, size);
+  }
 
   bool result = transfer.completed == size;
   
   if(!result) {
-    SET_ERROR(XLINK_ERROR_LIBUSB,
-              "transfer timeout (%d of %d bytes received)", transfer.completed, size);
+    SET_ERROR(detached ? XLINK_ERROR_DISCONNECTED : XLINK_ERROR_LIBUSB,
+              "%s at offset $%04x (%d of %d bytes received)",
+              detached ? "adapter disconnected" : "transfer timeout",
+              transfer.completed, transfer.completed, size);
   }
   
   CLEAR_ERROR_IF(result);
@@ -320,13 +889,17 @@ bool driver_usb_receive(unsigned char* data, int size) {
 //------------------------------------------------------------------------------
 
 void driver_usb_input() {
-  control(CMD_INPUT);
+  if(!input) {
+    control(CMD_INPUT);
+    input = true;
+  }
 }
 
 //------------------------------------------------------------------------------
 
 void driver_usb_output() {
   control(CMD_OUTPUT);
+  input = false;
 }
 
 //------------------------------------------------------------------------------
@@ -334,12 +907,146 @@ void driver_usb_output() {
 bool driver_usb_ping() { 
   driver->output();
   driver->write(XLINK_COMMAND_PING);
-  driver->strobe();
+
+  if(notify) {
+    // announce the wait, the firmware then reports the ACK edge as event
+    if(++sequence == 0) sequence++;
+    armed = sequence;
+    controlEndpointOutWithValue(CMD_STROBE, armed);
+  }
+  else {
+    driver->strobe();
+  }
   return driver->wait(250);
 }
 
 //------------------------------------------------------------------------------
 
+bool driver_usb_transact(bool ping, unsigned char* request, int size,
+                         unsigned char* response, int length) {
+
+  unsigned char buffer[TRANSACT_MAX_REQUEST];
+  unsigned char result[1+TRANSACT_MAX_RESPONSE];
+  int offset = ping ? 1 : 0;
+  
+  if(!transact || offset+size > TRANSACT_MAX_REQUEST || length > TRANSACT_MAX_RESPONSE) {
+    return driver_transact(ping, request, size, response, length);
+  }
+
+  // the firmware runs the whole sequence and leaves the port as input
+  
+  buffer[0] = XLINK_COMMAND_PING;
+  memcpy(buffer+offset, request, size);
+
+  input = false;
+  
+  if(checked(libusb_control_transfer(handle,
+                                     LIBUSB_REQUEST_TYPE_VENDOR |
+                                     LIBUSB_RECIPIENT_DEVICE |
+                                     LIBUSB_ENDPOINT_OUT,
+                                     CMD_TRANSACT, length, driver->timeout,
+                                     buffer, offset+size, (driver->timeout+1)*1036)) < 0) {
+    SET_ERROR(detached ? XLINK_ERROR_DISCONNECTED : XLINK_ERROR_LIBUSB, "transaction request failed");
+    return false;
+  }
+  input = true;
+
+  int received = bulkEndpoint(BULK_IN_ENDPOINT, result, 1+length);
+  
+  if(received < 1) {
+    SET_ERROR(detached ? XLINK_ERROR_DISCONNECTED : XLINK_ERROR_LIBUSB, "no transaction result");
+    return false;
+  }
+
+  if(ping && result[0] == 0) {
+    SET_ERROR(XLINK_ERROR_SERVER, "no response from server");
+    return false;
+  }
+  
+  if(result[0] < offset+size) {
+    SET_ERROR(XLINK_ERROR_LIBUSB,
+              "transfer timeout (%d of %d bytes sent)", result[0]-offset, size);
+    return false;
+  }
+
+  if(received < 1+length) {
+    SET_ERROR(XLINK_ERROR_LIBUSB,
+              "transfer timeout (%d of %d bytes received)", received-1, length);
+    return false;
+  }
+  
+  memcpy(response, result+1, length);
+  
+  CLEAR_ERROR;
+  return true;
+}
+
+//------------------------------------------------------------------------------
+
+bool driver_usb_loopback(bool enabled) {
+
+  int release = driver_usb_release();
+  
+  if(release < LOOPBACK_RELEASE) {
+    SET_ERROR(XLINK_ERROR_DEVICE, "firmware %x.%02x has no loopback mode",
+              release >> 8, release & 0xff);
+    return false;
+  }
+
+  if(controlEndpointOutWithValue(CMD_LOOPBACK, enabled ? 1 : 0) < 0) {
+    SET_ERROR(detached ? XLINK_ERROR_DISCONNECTED : XLINK_ERROR_LIBUSB,
+              "could not switch loopback mode");
+    return false;
+  }
+  
+  CLEAR_ERROR;
+  return true;
+}
+
+//------------------------------------------------------------------------------
+
+static uint le32(unsigned char* data) {
+  return data[0] | data[1] << 8 | data[2] << 16 | (uint) data[3] << 24;
+}
+
+bool driver_usb_stats(xlink_stats_t* stats, bool clear) {
+
+  unsigned char data[STATS_SIZE];
+  int release = driver_usb_release();
+  
+  if(release < STATS_RELEASE) {
+    SET_ERROR(XLINK_ERROR_DEVICE, "firmware %x.%02x keeps no counters",
+              release >> 8, release & 0xff);
+    return false;
+  }
+
+  if(checked(libusb_control_transfer(handle,
+                                     LIBUSB_REQUEST_TYPE_VENDOR |
+                                     LIBUSB_RECIPIENT_DEVICE |
+                                     LIBUSB_ENDPOINT_IN,
+                                     CMD_STATS, clear ? 1 : 0, 0,
+                                     data, sizeof(data), 1000)) < (int) sizeof(data)) {
+    SET_ERROR(detached ? XLINK_ERROR_DISCONNECTED : XLINK_ERROR_LIBUSB,
+              "could not read counters");
+    return false;
+  }
+
+  stats->sent     = le32(data);
+  stats->received = le32(data+4);
+  stats->packets  = le32(data+8);
+  stats->timeouts = data[12] | data[13] << 8;
+  stats->resets   = data[14] | data[15] << 8;
+
+  for(int i=0; i<STATS_BUCKETS; i++) {
+    stats->waits[i] = le32(data+16+i*4);
+  }
+  
+  CLEAR_ERROR;
+  return true;
+}
+
+//------------------------------------------------------------------------------
+
 void driver_usb_reset() { 
   control(CMD_RESET);
 }
@@ -354,8 +1061,15 @@ void driver_usb_boot() {
 
 void driver_usb_close() {
   if(handle != NULL) {
+    if(bulk) {
+      libusb_release_interface(handle, 0);
+      bulk = false;
+      transact = false;
+      notify = false;
+      armed = 0;
+    }
     libusb_close(handle);
-    libusb_exit(NULL);
+    handle = NULL;
   }
 }
 
@@ -363,6 +1077,15 @@ void driver_usb_close() {
 
 void driver_usb_free() {
   handle = NULL;
+
+  attached[0] = '\0'; // the device selected next starts afresh
+  attached_bus = attached_address = -1;
+
+  if(context != NULL) {
+    libusb_hotplug_deregister_callback(context, hotplug);
+    libusb_exit(context);
+    context = NULL;
+  }
 }
 
 //------------------------------------------------------------------------------
@@ -382,22 +1105,34 @@ int controlEndpointOut(int message, unsigned char *buffer, int size) {
 }
 
 int controlEndpointOutWithValue(int message, int value) {
-  return libusb_control_transfer(handle,
+  return checked(libusb_control_transfer(handle,
                                  LIBUSB_REQUEST_TYPE_VENDOR |
                                  LIBUSB_RECIPIENT_DEVICE |
                                  LIBUSB_ENDPOINT_OUT, 
                                  message, value, driver->timeout,
-                                 NULL, 0, (driver->timeout+1)*1036);
-  
+                                 NULL, 0, (driver->timeout+1)*1036));
 }
 
 int controlEndpoint(int message, unsigned char *buffer, int size, int direction) {
-  return libusb_control_transfer(handle,
+  return checked(libusb_control_transfer(handle,
                                  LIBUSB_REQUEST_TYPE_VENDOR |
                                  LIBUSB_RECIPIENT_DEVICE |
                                  direction, 
                                  message, 0, driver->timeout,
-                                 buffer, size, (driver->timeout+1)*1036);
+                                 buffer, size, (driver->timeout+1)*1036));
+}
+
+int bulkEndpoint(unsigned char endpoint, unsigned char *buffer, int size) {
+
+  int transfered = 0;
+  int result = checked(libusb_bulk_transfer(handle, endpoint, buffer, size, &transfered,
+                                            (driver->timeout+1)*1036));
+
+  if(result == LIBUSB_ERROR_PIPE) {
+    libusb_clear_halt(handle, endpoint); // the firmware stalls on timeout
+  }
+  
+  return (result == 0 || transfered > 0) ? transfered : result;
 }
 
 //------------------------------------------------------------------------------
@@ -3,6 +3,8 @@
 
 #include <libusb-1.0/libusb.h>
 
+#include "xlink.h"
+
 typedef struct {
   unsigned int vid;
   unsigned int pid;
@@ -13,8 +15,12 @@ typedef struct {
 
 void driver_usb_lookup(char* path, DeviceInfo* info);
 libusb_device_handle* driver_usb_open_device(libusb_context* context, DeviceInfo *info);
+int driver_usb_enumerate(xlink_device_t* devices, int max);
 
+bool driver_usb_setup(void);
 bool driver_usb_open(void);
+int driver_usb_release(void);
+bool driver_usb_claim_bulk(void);
 void driver_usb_close(void);
 void driver_usb_strobe (void);
 bool driver_usb_wait(int);
@@ -28,11 +34,15 @@ bool driver_usb_ping(void);
 void driver_usb_reset(void);
 void driver_usb_boot(void);
 void driver_usb_free(void);
+bool driver_usb_transact(bool, unsigned char*, int, unsigned char*, int);
+bool driver_usb_loopback(bool);
+bool driver_usb_stats(xlink_stats_t*, bool);
 
 int control(int message);
 int controlEndpointIn(int message, unsigned char *buffer, int size);
 int controlEndpointOut(int message, unsigned char *buffer, int size);
 int controlEndpointOutWithValue(int message, int value);
 int controlEndpoint(int message, unsigned char *buffer, int size, int direction);
+int bulkEndpoint(unsigned char endpoint, unsigned char *buffer, int size);
 
 #endif // USB_H
@@ -4,6 +4,8 @@
 
 .import source "server.h"
 
+.label handlers = $0b00 // extension handlers in the tape buffer, unused as tape I/O is disabled; cleared by boot
+
 //------------------------------------------------------------------------------	
 	
 .pc = $fa66 // wedge into system irq
@@ -61,39 +63,24 @@ irq: {
 	ldy $dd01
 	jsr ack
 
-!next:	cpy #Command.load 
-	bne !next+
-	jmp load
-
-!next:	cpy #Command.save
-	bne !next+
-	jmp save
+	cpy #Command.extension
+	bcs !skip+
 
-!next:	cpy #Command.peek
-	bne !next+
-	jmp peek
-	
-!next:	cpy #Command.poke
-	bne !next+
-	jmp poke
+	tya             // built-in command, jump via the command table
+	asl
+	tax
+	lda commands+1,x
+	pha
+	lda commands,x
+	pha
+	rts
 
-!next:	cpy #Command.jump
-	bne !next+
-	jmp jump
+!skip:	cpy #Command.identify
+	bne !skip+
+	jmp identify
 
-!next:	cpy #Command.run
-	bne !next+
-	jmp run
+!skip:	jsr extension
 
-!next:	cpy #Command.inject
-	bne !next+
-	jmp inject	
-	
-!next:	cpy #Command.identify
-	bne !next+
-	jmp identify
-        
-!next:        
 done:   jsr jrsirq
         jmp irqwedge.resume
 eof:    
@@ -187,6 +174,34 @@ done:   jmp irq.done
 eof:	
 }
 
+//------------------------------------------------------------------------------
+
+fill: {
+	jsr readHeader
+	jsr read txa pha   // keep fill value on the stack
+	:screenOff()
+
+	:checkBank()
+
+near:	pla tax
+	ldy #$00
+!loop:	txa
+	sta (start),y
+	:next()
+	jmp done
+
+far:	pla sta bank       // bank is no longer needed once mem is set
+	:jsrcommon(code.fillfar)
+
+done:	:screenOn()
+	:output()          // report completion, a large fill takes seconds
+	lda #$00
+	jsr write
+	:input()
+	jmp irq.done
+eof:	
+}
+
 //------------------------------------------------------------------------------
 	
 peek: {
@@ -277,20 +292,12 @@ identify: {
         lda Server.size
         jsr write
 
-        lda Server.id
-        jsr write
-
-        lda Server.id+1
+        ldy #$00       // id, followed by capabilities and protocol
+!loop:  lda Server.id,y
         jsr write
-
-        lda Server.id+2
-        jsr write
-
-        lda Server.id+3
-        jsr write
-
-        lda Server.id+4
-        jsr write        
+        iny
+        cpy Server.size
+        bne !loop-
         
         lda Server.version
         jsr write
@@ -382,6 +389,23 @@ slow_sendfar: {
 eof:	
 }
 
+fillfar: {
+.pseudopc common {
+	lda mmu sta saved
+	lda mem sta mmu
+	ldx bank           // fill value
+
+	ldy #$00
+!loop:	txa
+	sta (start),y
+	:next()
+
+	lda saved sta mmu
+	rts
+}
+eof:
+}
+
 fast_sendfar: {
 .pseudopc common {
 	lda mmu sta saved
@@ -453,9 +477,56 @@ write: {
 	rts
 eof:
 }
+
+//------------------------------------------------------------------------------
+
+commands: {             // address-1 of each built-in command, by id
+	.word irq.done-1 // $00 unused
+	.word load-1
+	.word save-1
+	.word poke-1
+	.word peek-1
+	.word jump-1
+	.word run-1
+	.word inject-1
+	.word irq.done-1 // hunt
+	.word irq.done-1 // compare
+	.word irq.done-1 // session
+	.word irq.done-1 // end
+	.word irq.done-1 // loadz
+	.word fill-1
+	.word irq.done-1 // relocate
+	.word register-1
+eof:
+}
+
+.if(commands.eof - commands != Command.extension * 2) .error "command table out of sync"
+
+//------------------------------------------------------------------------------
+
+register: {             // register the handler for an extension command
+	:storeHandler(handlers)
+	jmp irq.done
+eof:
+}
+
+//------------------------------------------------------------------------------
+
+extension: {            // run the handler registered for command y
+	:pushHandler(handlers)
+	rts
+eof:
+}
+
 //------------------------------------------------------------------------------		
 
 boot: {
+	lda #$00    // forget extension handlers of a previous session
+	ldx #[extensions * 2 - 1]
+!loop:	sta handlers,x
+	dex
+	bpl !loop-
+
 	ldx #12     // center boot message...
 	            // 12 spaces in 40 column mode
 
@@ -495,8 +566,10 @@ eof:
 //------------------------------------------------------------------------------		
 
 Server: {
-size:    .byte $05
-id:      .byte 'X', 'L', 'I', 'N', 'K'
+size:    .byte $09
+id:      .byte 'X', 'L', 'I', 'N', 'K', $00
+capabilities: .word Capability.fast | Capability.fill | Capability.extension
+protocol: .byte protocolVersion
 start:   .word irq
 version: .byte $10
 type:    .byte $01 // 0 = RAM, 1 = ROM
@@ -504,6 +577,9 @@ machine: .byte $01 // 0 = C64, 1 = C128
 end:     .word *+2
 eof:   
 }
+
+// GETIN at $eeeb is the first kernal routine after the tape code that must stay
+.if(Server.eof > $eeeb) .error "server exceeds the tape routine area"
         
 .pc = $10000
 
@@ -526,6 +602,7 @@ eof:
 .eval command = command + patch(irq, irq.eof)
 .eval command = command + patch(load, load.eof)
 .eval command = command + patch(save, save.eof)
+.eval command = command + patch(fill, fill.eof)
 .eval command = command + patch(peek, peek.eof)
 .eval command = command + patch(poke, poke.eof)
 .eval command = command + patch(jump, jump.eof)
@@ -538,6 +615,9 @@ eof:
 .eval command = command + patch(read, read.eof)                
 .eval command = command + patch(write, write.eof)
 .eval command = command + patch(identify, identify.eof)
+.eval command = command + patch(commands, commands.eof)
+.eval command = command + patch(register, register.eof)
+.eval command = command + patch(extension, extension.eof)
 .eval command = command + patch(boot, boot.eof)	
 .eval command = command + patch(Server, Server.eof)                
         
@@ -547,3 +627,11 @@ eof:
 
 .print command
 //------------------------------------------------------------------------------			
+
+.function region(name, start, end, limit) {
+	.return name + ": $" + toHexString(start) + "-$" + toHexString(limit) + ": " +
+	        toIntString(end-start) + " bytes used, " + toIntString(limit-end) + " bytes free"
+}
+
+.print ""
+.print region("tape", irq, Server.eof, $eeeb)
@@ -4,6 +4,9 @@
 
 .import source "server.h"
 
+.label handlers = $03f0 // extension handlers, page 3 is cleared on reset
+.label diskData = $03ea // virtual disk device, original vectors and timer
+
 //------------------------------------------------------------------------------	
 	
 .pc = $ea31
@@ -74,44 +77,36 @@ irq: {
 	ldy $dd01
 	jsr ack
 
-!next:	cpy #Command.load  // dispatch command...
-	bne !next+
-	jmp load
+	cpy #Command.extension
+	bcs !skip+
 
-!next:	cpy #Command.save
-	bne !next+
-	jmp save
+	tya             // built-in command, jump via the command table
+	asl
+	tax
+	lda commands+1,x
+	pha
+	lda commands,x
+	pha
+	rts
 
-!next:	cpy #Command.peek
-	bne !next+
-	jmp peek
-	
-!next:	cpy #Command.poke
-	bne !next+
-	jmp poke
-	
-!next:	cpy #Command.jump
-	bne !next+
-	jmp jump
+!skip:	cpy #Command.identify
+	bne !skip+
+	jmp identify
 
-!next:	cpy #Command.run
-	bne !next+
-	jmp run
+!skip:	cpy #Command.serve
+	bne !skip+
+	jsr vdisk.announce
+	jmp done
 
-!next:	cpy #Command.inject
-	bne !next+
-	jmp inject
+!skip:	jsr extension
 
-!next:	cpy #Command.identify
-	bne !next+
-	jmp identify
-        
-!next:
 done:	jsr jiffy
 	jmp sysirq+3
 eof:
 }
 
+.if(irq.eof > $f5ab) .error "irq exceeds the tape load area"
+
 //------------------------------------------------------------------------------		
 
 .pc = $f5ab // end of kernal "Load Tape" routine
@@ -301,6 +296,38 @@ eof:
 
 //------------------------------------------------------------------------------		
 
+fill: {
+	jsr readHeader
+	jsr read       // keep fill value in x
+	:screenOff()
+
+	ldy #$00
+
+	lda mem        // write to ram with io disabled unless requested
+	and #$7f
+	cmp #$37
+	beq !loop+
+	lda #$33
+	sta $01
+
+!loop:	txa
+	sta (start),y
+	:next()
+
+	lda #$37
+	sta $01
+
+	:screenOn()
+	:output()      // report completion, a large fill takes seconds
+	lda #$00
+	jsr write
+	:input()
+	jmp irq.done
+eof:	
+}
+
+//------------------------------------------------------------------------------		
+
 poke: {
 	jsr read stx mem
 	jsr read stx bank
@@ -420,20 +447,12 @@ identify: {
         lda Server.size
         jsr write
 
-        lda Server.id
+        ldy #$00       // id, followed by capabilities and protocol
+!loop:  lda Server.id,y
         jsr write
-
-        lda Server.id+1
-        jsr write
-
-        lda Server.id+2
-        jsr write
-
-        lda Server.id+3
-        jsr write
-
-        lda Server.id+4
-        jsr write        
+        iny
+        cpy Server.size
+        bne !loop-
         
         lda Server.version
         jsr write
@@ -469,6 +488,50 @@ done:   lda #$00   // reset CIA2 port B to input
 eof:    
 }
 
+//------------------------------------------------------------------------------
+
+commands: {             // address-1 of each built-in command, by id
+	.word irq.done-1 // $00 unused
+	.word load-1
+	.word save-1
+	.word poke-1
+	.word peek-1
+	.word jump-1
+	.word run-1
+	.word inject-1
+	.word irq.done-1 // hunt
+	.word irq.done-1 // compare
+	.word irq.done-1 // session
+	.word irq.done-1 // end
+	.word irq.done-1 // loadz
+	.word fill-1
+	.word irq.done-1 // relocate
+	.word register-1
+eof:
+}
+
+.if(commands.eof - commands != Command.extension * 2) .error "command table out of sync"
+
+//------------------------------------------------------------------------------
+
+register: {             // register the handler for an extension command
+	:storeHandler(handlers)
+	jmp irq.done
+eof:
+}
+
+//------------------------------------------------------------------------------
+
+extension: {            // run the handler registered for command y
+	:pushHandler(handlers)
+	rts
+eof:
+}
+
+//------------------------------------------------------------------------------
+
+.import source "vdisk.asm"
+
 //------------------------------------------------------------------------------
         
 memoryCheck: { // relocated original memory check routine 
@@ -506,8 +569,10 @@ eof:
 //------------------------------------------------------------------------------
         
 Server: {
-size:    .byte $05
-id:      .byte 'X', 'L', 'I', 'N', 'K'
+size:    .byte $09
+id:      .byte 'X', 'L', 'I', 'N', 'K', $00
+capabilities: .word Capability.fill | Capability.extension | Capability.disk
+protocol: .byte protocolVersion
 start:   .word irq
 version: .byte $10
 type:    .byte $01 // 0 = RAM, 1 = ROM
@@ -515,6 +580,8 @@ machine: .byte $00 // 0 = C64
 end:     .word *+2
 eof:   
 }
+
+.if(Server.eof > $fc92) .error "server exceeds the tape read/write area"
         
 //------------------------------------------------------------------------------	
 	
@@ -556,17 +623,28 @@ eof:
 .eval command = command + patch(readHeader, readHeader.eof)
 .eval command = command + patch(load, load.eof)
 .eval command = command + patch(save, save.eof)
+.eval command = command + patch(fill, fill.eof)
 .eval command = command + patch(poke, poke.eof)
 .eval command = command + patch(peek, peek.eof)	
 .eval command = command + patch(jump, jump.eof)
 .eval command = command + patch(run, run.eof)
 .eval command = command + patch(inject, inject.eof)
 .eval command = command + patch(identify, identify.eof)
+.eval command = command + patch(commands, commands.eof)
+.eval command = command + patch(register, register.eof)
+.eval command = command + patch(extension, extension.eof)
+.eval command = command + patch(vdisk, vdisk.eof)
 .eval command = command + patch(memoryCheck, memoryCheck.eof)
 .eval command = command + patch(Server, Server.eof)        
 
 .print command
 //------------------------------------------------------------------------------			
+
+.function region(name, start, end, limit) {
+	.return name + ": $" + toHexString(start) + "-$" + toHexString(limit) + ": " +
+	        toIntString(end-start) + " bytes used, " + toIntString(limit-end) + " bytes free"
+}
+
 .print ""
-.print "free: 0x" + toHexString(irq.eof) + "-0xf5ab" + ": " + toIntString($f5ab-irq.eof) + " bytes"
-.print "free: 0x" + toHexString(memoryCheck.eof) + "-0xfc92" + " " + toIntString($fc92-memoryCheck.eof) + " bytes"
+.print region("tape load", disableTapeLoad, irq.eof, $f5ab)
+.print region("tape read/write", wait, Server.eof, $fc92)
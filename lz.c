@@ -0,0 +1,92 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "lz.h"
+#include "util.h"
+
+//------------------------------------------------------------------------------
+
+static uint lz_hash(uchar* data) {
+  return ((data[0] << 8) ^ (data[1] << 4) ^ data[2]) & ((1 << XLINK_LZ_HASH_BITS)-1);
+}
+
+//------------------------------------------------------------------------------
+
+uint lz_compress(uchar* data, uint size, uchar* packed,
+                 uint* tokens, uint* matched) {
+
+  // Tokens with bit 7 cleared announce a run of token+1 literal bytes,
+  // otherwise the next (token & 0x7f)+3 bytes are copied from offset
+  // bytes back (16 bit offset follows, low byte first). Both runs are
+  // decoded byte by byte in ascending order, so a back reference may
+  // overlap itself.
+  
+  int head[1 << XLINK_LZ_HASH_BITS];
+  int* chain = (int*) calloc(size, sizeof(int));
+  uint length = 0;
+  uint literals = 0;
+  uint i = 0;
+  
+  memset(head, 0xff, sizeof(head));
+  *tokens = 0;
+  *matched = 0;
+  
+  while(i <= size) {
+
+    uint best = 0;
+    uint offset = 0;
+    
+    if(i + XLINK_LZ_MIN_MATCH <= size) {
+
+      uint limit = size - i < XLINK_LZ_MAX_MATCH ? size - i : XLINK_LZ_MAX_MATCH;
+      int depth = XLINK_LZ_MAX_CHAIN;
+      
+      for(int j = head[lz_hash(data+i)];
+          j >= 0 && depth-- > 0 && i - j <= XLINK_LZ_MAX_OFFSET; j = chain[j]) {
+
+        uint n = 0;
+        while(n < limit && data[j+n] == data[i+n]) n++;
+
+        if(n > best) {
+          best = n;
+          offset = i - j;
+          if(n == limit) break;
+        }
+      }
+    }
+
+    if(literals > 0 &&
+       (best >= XLINK_LZ_MIN_MATCH || literals == XLINK_LZ_MAX_LITERALS || i == size)) {
+      packed[length++] = literals - 1;
+      memcpy(packed+length, data+i-literals, literals);
+      length += literals;
+      literals = 0;
+      (*tokens)++;
+    }
+
+    if(i == size) break;
+    
+    if(best < XLINK_LZ_MIN_MATCH) {
+      best = 1;
+      literals++;
+    }
+    else {
+      packed[length++] = 0x80 | (best - XLINK_LZ_MIN_MATCH);
+      packed[length++] = lo(offset);
+      packed[length++] = hi(offset);
+      (*tokens)++;
+      *matched += best;
+    }
+
+    for(uint k = i + best; i < k; i++) {
+      if(i + XLINK_LZ_MIN_MATCH <= size) {
+        uint h = lz_hash(data+i);
+        chain[i] = head[h];
+        head[h] = i;
+      }
+    }
+  }
+
+  free(chain);
+  return length;
+}
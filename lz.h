@@ -0,0 +1,19 @@
+#ifndef LZ_H
+#define LZ_H
+
+#include "xlink.h"
+
+#define XLINK_LZ_MIN_MATCH     3    // shortest back reference worth encoding
+#define XLINK_LZ_MAX_MATCH     130  // longest back reference (0x7f + 3)
+#define XLINK_LZ_MAX_LITERALS  128  // longest literal run (0x7f + 1)
+#define XLINK_LZ_MAX_OFFSET    0xffff
+#define XLINK_LZ_HASH_BITS     12
+#define XLINK_LZ_MAX_CHAIN     64   // candidates tried per position
+
+// packed needs room for size + size/4 + 2 bytes (single literals
+// separated by minimal back references); returns the packed length
+
+uint lz_compress(uchar* data, uint size, uchar* packed,
+                 uint* tokens, uint* matched);
+
+#endif // LZ_H
@@ -6,6 +6,8 @@ extern unsigned char* xlink_server_basic_c64(int *size);
 extern unsigned char* xlink_server_c128(unsigned short address, int *size);
 extern unsigned char* xlink_server_basic_c128(int *size);
 
+extern unsigned char* xlink_stub_c64(int *size);
+
 extern void xlink_kernal_c64(unsigned char* image);
 extern void xlink_kernal_c128(unsigned char* image);
 
@@ -30,8 +32,11 @@ xlink_machine_t c64 = {
   .hirom               = 0xe0000000,
   .benchmark           = 0x10008000,
   .free_ram_area       = 0xc000,
+  .vectors             = 0x03000334,
+  .overlays            = XLINK_CAPABILITY_HUNT | XLINK_CAPABILITY_COMPARE,
   .server              = &xlink_server_c64,
   .basic_server        = &xlink_server_basic_c64,
+  .stub                = &xlink_stub_c64,
   .kernal              = &xlink_kernal_c64,
 };
 
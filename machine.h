@@ -34,8 +34,11 @@ typedef struct {
   uint hirom;
   uint benchmark;
   ushort free_ram_area;
+  uint vectors;
+  ushort overlays;
   uchar* (*server) (ushort address, int *size);
   uchar* (*basic_server) (int *size);
+  uchar* (*stub) (int *size);
   void (*kernal) (uchar *image);
 } xlink_machine_t;
 
@@ -64,6 +64,7 @@
 .var reinst  = $e0ee
    
 .var saved = $ff
+.var speed = $fa        // Clock speed before a transfer
    
 // Commands:
 	
@@ -75,8 +76,49 @@
 .label jump        = $05
 .label run         = $06
 .label inject      = $07
+.label hunt        = $08
+.label compare     = $09
+.label session     = $0a
+.label end         = $0b
+.label loadz       = $0c
+.label fill        = $0d
+.label relocate    = $0e
+.label register    = $0f
+.label extension   = $10 // first of the commands registered by the host
+.label serve       = $fc
+.label ping        = $fd
 .label identify    = $fe
 }
+
+// Capabilities announced via identify:
+
+.namespace Capability {
+.label hunt        = $0001
+.label compare     = $0002
+.label session     = $0004
+.label loadz       = $0008
+.label reu         = $0010
+.label fill        = $0020
+.label fast        = $0040
+.label linear      = $0080
+.label vdc         = $0100
+.label overlay     = $0200
+.label relocate    = $0400
+.label extension   = $0800
+.label disk        = $1000
+}
+
+// Requests sent in reply to the serve command:
+
+.namespace Serve {
+.label none        = $00
+.label load        = $01
+.label save        = $02
+}
+
+.var extensions = 8        // number of extension commands, a power of two
+
+.var protocolVersion = $02 // Protocol version announced via identify
 	
 .macro wait() { // Wait for handshake from PC (falling edge on FLAG)
 loop:	lda $dd0d
@@ -125,6 +167,38 @@ check:	lda start+1
 	bne !loop-
 }
    
+.macro storeHandler(handlers) { // register the handler for an extension command
+	jsr read        // command
+	txa
+	sec
+	sbc #Command.extension
+	and #[extensions-1]
+	asl
+	tay
+	jsr read        // handler address-1, sent msb first like inject
+	txa
+	sta handlers+1,y
+	jsr read
+	txa
+	sta handlers,y
+}
+
+.macro pushHandler(handlers) { // push the handler for command y, if any
+	tya
+	sec
+	sbc #Command.extension
+	cmp #extensions
+	bcs none
+	asl
+	tax
+	lda handlers+1,x
+	beq none        // not registered
+	pha
+	lda handlers,x
+	pha
+none:	
+}
+
 .macro checkBank() {
         lda mem
 	cmp mmu	
@@ -185,14 +259,27 @@ done:
 }
 	
 .macro screenOff() {
+	.if(target == "c128") {
+	  lda $d030       // run at 2MHz while the screen is blanked
+	  sta speed
+	}
 	bit mem
 	bmi skip
 	lda #$0b
 	sta $d011
+	.if(target == "c128") {
+	  lda speed
+	  ora #$01
+	  sta $d030
+	}
 skip:	
 }
 
 .macro screenOn() {
+	.if(target == "c128") {
+	  lda speed       // restore previous clock speed
+	  sta $d030
+	}
 	bit mem
 	bmi skip
 	lda #$1b
@@ -53,53 +53,93 @@ irq: {
 	ldy $dd01 // read command
 	:ack()   
 
-!next:	cpy #Command.load  // dispatch command
-	bne !next+
-	jmp load
-
-!next:	cpy #Command.save
-	bne !next+
-	jmp save
+	jsr dispatch
 
-!next:	cpy #Command.peek
-	bne !next+
-	jmp peek
-	
-!next:	cpy #Command.poke
-	bne !next+
-	jmp poke
-
-!next:	cpy #Command.jump
-	bne !next+
-	jmp jump
+done:   cld
+	jsr jrsirq
+	jmp sysirq+4
+}
 
-!next:	cpy #Command.run
-	bne !next+
-	jmp run
+//------------------------------------------------------------------------------
 
-!next:	cpy #Command.inject
-	bne !next+
-	jmp inject
+dispatch: {             // execute command in y
+	cpy #Command.extension
+	bcs !skip+
+
+	tya             // built-in command, jump via the command table
+	asl
+	tax
+	lda commands+1,x
+	pha
+	lda commands,x
+	pha
+	rts
 
-!next:	cpy #Command.identify
-	bne !next+
+!skip:	cpy #Command.identify
+	bne !skip+
 	jmp identify
 
-
-!next:	
-done:   cld
-	jsr jrsirq
-	jmp sysirq+4
+!skip:	:pushHandler(handlers)
+none:	rts
+
+commands:               // address-1 of each built-in command, by id
+	.word none-1    // $00 unused
+	.word load-1
+	.word save-1
+	.word poke-1
+	.word peek-1
+	.word jump-1
+	.word run-1
+	.word inject-1
+	.word hunt-1
+	.word compare-1
+	.word session-1
+	.word none-1    // end, only valid within a session
+	.word loadz-1
+	.word fill-1
+	.word relocate-1
+	.word register-1
+
+.if(* - commands != Command.extension * 2) .error "command table out of sync"
 }
 
 //------------------------------------------------------------------------------
 	
 load: {
 	jsr readHeader
-	:screenOff()	
-	:checkBasic()
+	:screenOff()
+
+	bit bank        // load into REU?
+	bpl !skip+
+	jsr reu.load
+	jmp done
+
+!skip:	bvc !skip+      // load across RAM banks?
+	lda #<receive
+	ldx #>receive
+	jsr linear
+	jmp done
 	
-	:checkBank()
+!skip:	lda bank        // load into VDC RAM?
+	and #$20
+	beq !skip+
+	jsr vdc.load
+	jmp done
+
+!skip:	:checkBasic()
+	jsr receive
+	:relinkBasic()
+
+done:	:screenOn()
+	rts
+}
+
+//------------------------------------------------------------------------------
+
+receive: {              // receive start-end in the requested bank
+	jsr setup
+	bit Data.far
+	bmi far
 	
 near:	ldy #$00	
 !loop:  :wait()
@@ -116,9 +156,110 @@ slow:   :jsrcommon(code.slow_receivefar)
 
 fast:   :jsrcommon(code.fast_receivefar)
 	
-done:   :screenOn()
+done:   jmp finish
+}
+
+//------------------------------------------------------------------------------
+
+loadz: {                // load lz compressed data (see lz_compress in lz.c)
+	jsr readHeader
+	:screenOff()
+	:checkBasic()
+
+	jsr setup
+
+token:	jsr read        // literal run or back reference?
+	txa
+	bmi match
+
+	tax             // receive token+1 literal bytes
+	inx
+	stx Data.length
+
+	ldy #$00
+literal: :wait()
+	lda $dd01
+	jsr put
+	:ack()
+	iny
+	cpy Data.length
+	bne literal
+	jmp advance
+
+match:	and #$7f        // copy token-$80+3 bytes from offset bytes back
+	clc
+	adc #$03
+	sta Data.length
+
+	jsr read stx Data.offset
+	jsr read stx Data.offset+1
+
+	ldy #$00
+	bit Data.far
+	bmi far
+
+	sec             // near: read back via absolute address
+	lda start
+	sbc Data.offset
+	sta copy+1
+	lda start+1
+	sbc Data.offset+1
+	sta copy+2
+
+copy:	lda $ffff,y
+	sta (start),y
+	iny
+	cpy Data.length
+	bne copy
+	jmp advance
+
+far:	jsr back        // far: move the pointer back for each byte
+	jsr get
+	pha
+	jsr forth
+	pla
+	jsr put
+	iny
+	cpy Data.length
+	bne far
+
+advance: tya            // skip the decoded bytes
+	clc
+	adc start
+	sta start
+	bcc !skip+
+	inc start+1
+
+!skip:	lda start
+	cmp end
+	bne !next+
+	lda start+1
+	cmp end+1
+	beq done
+!next:	jmp token
+
+done:	jsr finish
+	:screenOn()
 	:relinkBasic()
-	jmp irq.done
+	rts
+
+back:	sec
+	lda start
+	sbc Data.offset
+	sta start
+	lda start+1
+	sbc Data.offset+1
+	sta start+1
+	rts
+
+forth:	clc
+	lda start
+	adc Data.offset
+	sta start
+	lda start+1
+	adc Data.offset+1
+	sta start+1
+	rts
 }
 
 //------------------------------------------------------------------------------
@@ -129,7 +270,36 @@ save: {
 	
         :output()
 
-	:checkBank()
+	bit bank        // save from REU?
+	bpl !skip+
+	jsr reu.save
+	jmp done
+
+!skip:	bvc !skip+      // save across RAM banks?
+	lda #<send
+	ldx #>send
+	jsr linear
+	jmp done
+
+!skip:	lda bank        // save from VDC RAM?
+	and #$20
+	beq !skip+
+	jsr vdc.save
+	jmp done
+
+!skip:	jsr send
+
+done:	:input()
+	:screenOn()
+	rts
+}	
+
+//------------------------------------------------------------------------------
+
+send: {                 // send start-end from the requested bank
+	jsr setup
+	bit Data.far
+	bmi far
 	
 near:	ldy #$00
 !loop:  lda (start),y  
@@ -144,10 +314,8 @@ slow:	:jsrcommon(code.slow_sendfar)
 
 fast:	:jsrcommon(code.fast_sendfar)
 
-done:	:input()
-	:screenOn()
-	jmp irq.done
-}	
+done:	jmp finish
+}
 
 //------------------------------------------------------------------------------
 	
@@ -174,7 +342,7 @@ far:    ldy #$00
 	ldx mem
 	pla jsr stash
 	
-done:   jmp irq.done
+done:   rts
 }
 
 //------------------------------------------------------------------------------
@@ -204,7 +372,7 @@ far:	lda #start
 
 done:   :input()
 	
-	jmp irq.done
+	rts
 }
 	
 //------------------------------------------------------------------------------
@@ -254,31 +422,690 @@ inject:	{
 	rts
 	
 return: nop
-	jmp irq.done
+	rts
+}
+
+//------------------------------------------------------------------------------
+
+hunt: {
+	jsr readHeader
+	jsr read stx Data.length
+
+	ldy #$00        // read pattern
+!loop:	jsr read txa
+	sta Data.pattern,y
+	iny
+	cpy Data.length
+	bne !loop-
+
+	ldy #$00        // read mask
+!loop:	jsr read txa
+	sta Data.mask,y
+	iny
+	cpy Data.length
+	bne !loop-
+
+	jsr read stx Data.count // maximum number of matches
+
+	sec             // stop where the pattern no longer fits
+	lda end
+	sbc Data.length
+	sta end
+	bcs !skip+
+	dec end+1
+!skip:	inc end
+	bne !skip+
+	inc end+1
+!skip:
+	:screenOff()
+	:output()
+
+	jsr setup
+	
+!loop:	ldy #$00
+match:	jsr get
+	eor Data.pattern,y
+	and Data.mask,y
+	bne miss
+	iny
+	cpy Data.length
+	bne match
+
+	lda #$01 jsr write // report match
+	lda start jsr write
+	lda start+1 jsr write
+
+	dec Data.count
+	beq done
+	
+miss:	:next()
+
+done:	lda #$00 jsr write // no more matches
+
+	jsr finish
+	:input()
+	:screenOn()
+	rts
+}
+
+//------------------------------------------------------------------------------
+
+compare: {
+	jsr readHeader
+	:screenOff()
+
+	jsr setup
+	
+	lda #$00
+	sta Data.count
+	sta Data.count+1
+
+	ldy #$00
+!loop:  :wait()
+	lda $dd01
+	sta Data.value
+	jsr get
+	eor Data.value
+	beq same
+
+	lda Data.count+1 // remember the first mismatches
+	bne count
+	lda Data.count
+	cmp #$10
+	bcs count
+	asl
+	tax
+	lda start
+	sta Data.buffer,x
+	lda start+1
+	sta Data.buffer+1,x
+
+count:	inc Data.count   // count all mismatches (saturated)
+	bne same
+	inc Data.count+1
+	bne same
+	dec Data.count
+	dec Data.count+1
+	
+same:	:ack()
+	:next()
+
+	:output()
+
+	lda Data.count jsr write
+	lda Data.count+1 jsr write
+
+	lda Data.count+1 // send the remembered mismatches
+	bne all
+	lda Data.count
+	cmp #$10
+	bcc some
+all:	lda #$10
+some:	asl
+	sta Data.length
+	beq done
+
+	ldy #$00
+!send:	lda Data.buffer,y
+	jsr write
+	iny
+	cpy Data.length
+	bne !send-
+	
+done:	jsr finish
+	:input()
+	:screenOn()
+	rts
+}
+
+//------------------------------------------------------------------------------
+
+vdc: {                  // VDC RAM transfers via the update address
+write:	stx $d600       // write a to VDC register x
+!busy:	bit $d600
+	bpl !busy-
+	sta $d601
+	rts
+
+read:	stx $d600       // read VDC register x into a
+!busy:	bit $d600
+	bpl !busy-
+	lda $d601
+	rts
+
+setup:	ldx #18         // set update address, select data register
+	lda start+1
+	jsr write
+	ldx #19
+	lda start
+	jsr write
+	ldx #31
+	stx $d600
+	rts
+
+load:	jsr setup
+!loop:  :wait()
+	lda $dd01
+!busy:	bit $d600
+	bpl !busy-
+	sta $d601       // the update address counts up
+	:ack()
+	:next()
+	rts
+
+save:	jsr setup
+!loop:
+!busy:	bit $d600
+	bpl !busy-
+	lda $d601
+	:write()
+	:next()
+	rts
+
+fill:	jsr setup       // the first byte is written as usual...
+	lda Data.value
+!busy:	bit $d600
+	bpl !busy-
+	sta $d601
+
+	ldx #24         // ...the rest by block writes repeating it
+	jsr read
+	and #$7f
+	jsr write
+
+block:	inc start       // advance past the bytes written
+	bne !skip+
+	inc start+1
+!skip:	lda start
+	cmp end
+	bne rest
+	lda start+1
+	cmp end+1
+	beq done
+
+rest:	sec             // at most 255 bytes per block write
+	lda end
+	sbc start
+	tay
+	lda end+1
+	sbc start+1
+	bne max
+	cpy #$ff
+	bcc some
+max:	ldy #$ff
+some:	tya
+	ldx #30
+	jsr write
+
+	dey             // one byte is added by block
+	tya
+	clc
+	adc start
+	sta start
+	bcc block
+	inc start+1
+	jmp block
+
+done:	rts
+}
+
+//------------------------------------------------------------------------------
+
+linear: {               // run transfer routine a/x across RAM banks
+	sta run+1
+	stx run+2
+
+	lda mem         // first bank | last bank << 4
+	sta Data.banks
+	lda end
+	sta Data.last
+	lda end+1
+	sta Data.last+1
+
+segment: lda Data.banks // select all RAM in the current bank
+	and #$0f
+	sta bank
+	tax
+	lda bank2mmu,x
+	sta mem
+
+	lda Data.banks  // last segment ends at the requested address,
+	lsr             // all others below the MMU registers
+	lsr
+	lsr
+	lsr
+	cmp bank
+	bne whole
+	lda Data.last
+	sta end
+	lda Data.last+1
+	sta end+1
+	jmp run
+
+whole:	lda #<$ff00
+	sta end
+	lda #>$ff00
+	sta end+1
+
+run:	jsr $ffff
+
+	lda Data.banks
+	lsr
+	lsr
+	lsr
+	lsr
+	cmp bank
+	beq done
+	inc Data.banks
+
+	lda #<$0400     // the next bank starts above the common RAM
+	sta start
+	lda #>$0400
+	sta start+1
+	jmp segment
+
+done:	rts
 }
 
 //------------------------------------------------------------------------------
+
+setup: {                // prepare get/put for the requested bank
+	:checkBank()
 	
+near:	lda #$00
+	beq done
+
+far:	jsr direct      // switch to the far bank for the whole transfer?
+	bcs kernal
+	jsr enter
+	lda #$40
+	bne done
+
+kernal:	lda #start      // otherwise access it via fetch/stash
+	sta fetchptr
+	sta stashptr
+	lda #$80
+
+done:	sta Data.far
+	rts
+}
+
+//------------------------------------------------------------------------------
+
+direct: {               // clear carry if the far bank can be used directly
+	lda Server.end+1
+	cmp #$20        // server must reside in the shared lower 8k
+	bcs no
+	lda start+1     // range must lie above the shared area
+	cmp #$20
+	bcc no
+
+	lda mem         // io is needed for the handshake
+	and #$01
+	beq yes
+
+	lda start+1     // io can be enabled if the range does not touch it
+	cmp #$e0
+	bcs clear
+	lda end+1
+	beq no
+	cmp #$d0
+	bcs no
+clear:	lda mem
+	and #$fe
+	sta Data.config
+	clc
+	rts
+
+yes:	lda mem
+	sta Data.config
+	clc
+	rts
+
+no:	sec
+	rts
+}
+
+//------------------------------------------------------------------------------
+
+enter: {                // share the lower 8k and switch to the far bank
+	lda $d506
+	sta Data.rcr
+	and #$f0
+	ora #$06
+	sta $d506
+	lda mmu
+	sta Data.cr
+	lda Data.config
+	sta mmu
+	rts
+}
+
+//------------------------------------------------------------------------------
+
+finish: {               // return from the far bank after a direct transfer
+	bit Data.far
+	bvc done
+	lda Data.cr
+	sta mmu
+	lda Data.rcr
+	sta $d506
+	lda #$00
+	sta Data.far
+done:	rts
+}
+
+//------------------------------------------------------------------------------
+
+get: {                  // read (start),y from the requested bank
+	bit Data.far
+	bmi far
+	lda (start),y
+	rts
+
+far:	ldx mem
+	jmp fetch
+}
+
+//------------------------------------------------------------------------------
+
+put: {                  // write a to (start),y in the requested bank
+	bit Data.far
+	bmi far
+	sta (start),y
+	rts
+
+far:	ldx mem
+	jmp stash
+}
+
+//------------------------------------------------------------------------------
+
+fill: {
+	jsr readHeader
+	jsr read stx Data.value
+	:screenOff()
+
+	bit bank        // fill REU?
+	bpl ram
+	jsr reu.fill
+	jmp done
+
+ram:	lda bank        // fill VDC RAM?
+	and #$20
+	beq !skip+
+	jsr vdc.fill
+	jmp done
+
+!skip:	jsr setup
+
+	ldy #$00
+!loop:	lda Data.value
+	jsr put
+	:next()
+	jsr finish
+
+done:	:screenOn()
+	:output()       // report completion, a large fill takes seconds
+	lda #$00
+	jsr write
+	:input()
+	rts
+}
+
+//------------------------------------------------------------------------------
+
+reu: {                  // REU transfers, mem holds the REU bank
+setup:	lda #<Data.value // each DMA moves one byte via Data.value
+	sta $df02
+	lda #>Data.value
+	sta $df03
+	lda start
+	sta $df04
+	lda start+1
+	sta $df05
+	lda mem
+	sta $df06
+	lda #$01
+	sta $df07
+	lda #$00
+	sta $df08
+	lda #$80        // fixed C64 address, REU address counts up
+	sta $df0a
+	rts
+
+load:	jsr setup
+!loop:  :wait()
+	lda $dd01
+	sta Data.value
+	:ack()
+	lda #$90        // stash
+	sta $df01
+	:next()
+	jmp done
+
+save:	jsr setup
+!loop:  lda #$91        // fetch
+	sta $df01
+	lda Data.value
+	:write()
+	:next()
+	jmp done
+
+fill:	jsr setup
+	sec             // a single DMA fills the whole range
+	lda end
+	sbc start
+	sta $df07
+	lda end+1
+	sbc start+1
+	sta $df08
+	lda #$90
+	sta $df01
+
+done:	lda #$00
+	sta $df0a
+	rts
+}
+
+//------------------------------------------------------------------------------
+
+session: {              // stay in a command loop until END or idle timeout
+	jsr read stx Data.flags
+	jsr read stx Data.timeout
+
+loop:	lda Data.flags  // keep screen blanked if requested
+	and #$01
+	beq wait
+	lda #$0b
+	sta $d011
+
+wait:	lda Data.timeout
+	sta Data.idle
+	ldx #$00
+	ldy #$00
+
+poll:	lda $dd0d       // wait for the next command
+	and #$10
+	bne command
+	dex
+	bne poll
+	dey
+	bne poll        // roughly one second per round
+	lda Data.timeout
+	beq poll        // no timeout
+	dec Data.idle
+	bne poll
+	beq done
+
+command: ldy $dd01
+	:ack()
+
+	cpy #Command.end
+	beq done
+	jsr dispatch
+	jmp loop
+
+done:	lda Data.flags
+	and #$01
+	beq exit
+	lda #$1b
+	sta $d011
+exit:	rts
+}
+
+//------------------------------------------------------------------------------
+	
+relocate: {             // copy the server to the address received and patch it
+	jsr read stx end        // the new area must not overlap the server
+	jsr read stx end+1
+
+	lda Server.start
+	sta start
+	lda Server.start+1
+	sta start+1
+
+	sec                     // displacement of the copy
+	lda end
+	sbc start
+	sta Data.count
+	lda end+1
+	sbc start+1
+	sta Data.count+1
+
+	sec                     // size of the code and the relocation table
+	lda Server.end
+	sbc start
+	sta Data.offset
+	lda Server.end+1
+	sbc start+1
+	sta Data.offset+1
+
+	ldy #$00                // copy full pages...
+	ldx Data.offset+1
+	beq rest
+page:	lda (start),y
+	sta (end),y
+	iny
+	bne page
+	inc start+1
+	inc end+1
+	dex
+	bne page
+
+rest:	ldx Data.offset         // ...and the remaining bytes
+	beq copied
+!loop:	lda (start),y
+	sta (end),y
+	iny
+	dex
+	bne !loop-
+
+copied:	clc                     // start of the copy
+	lda Server.start
+	adc Data.count
+	sta Data.offset
+	lda Server.start+1
+	adc Data.count+1
+	sta Data.offset+1
+
+	lda #<[relocations+2]   // skip the table size
+	sta mem
+	lda #>[relocations+2]
+	sta mem+1
+
+patch:	ldy #$01                // add the displacement to each reference
+	lda (mem),y
+	cmp #$ff
+	beq done
+
+	jsr target              // low byte
+	ldy #$00
+	lda (start),y
+	clc
+	adc Data.count
+	sta (start),y
+	php
+
+	ldy #$03                // high byte
+	jsr target
+	ldy #$00
+	plp
+	lda (start),y
+	adc Data.count+1
+	sta (start),y
+
+	clc
+	lda mem
+	adc #$04
+	sta mem
+	bcc patch
+	inc mem+1
+	jmp patch
+
+done:	lda #<irq               // switch the irq and re-entry to the copy
+	ldx #>irq
+	jsr moved
+	sta $0314
+	stx $0315
+
+	lda #<install
+	ldx #>install
+	jsr moved
+	sta $1901
+	stx $1902
+
+	:output()               // report completion
+	lda #$00
+	jsr write
+	:input()
+	rts
+
+moved:	clc                     // add the displacement to a/x
+	adc Data.count
+	pha
+	txa
+	adc Data.count+1
+	tax
+	pla
+	rts
+
+target:	lda (mem),y             // start = copy + offset at y-1
+	tax
+	dey
+	lda (mem),y
+	clc
+	adc Data.offset
+	sta start
+	txa
+	adc Data.offset+1
+	sta start+1
+	rts
+}
+
+//------------------------------------------------------------------------------
+
+register: {             // register the handler for an extension command
+	:storeHandler(handlers)
+	rts
+}
+
+handlers: .fill extensions * 2, $00 // address-1 of each extension handler
+
+//------------------------------------------------------------------------------
+
 identify: {
         :output()
 
         lda Server.size
         jsr write
   
-        lda Server.id
-        jsr write
-
-        lda Server.id+1
-        jsr write
-
-        lda Server.id+2
-        jsr write
-
-        lda Server.id+3
-        jsr write
-
-        lda Server.id+4
+        ldy #$00       // id, followed by capabilities and protocol
+!loop:  lda Server.id,y
         jsr write
+        iny
+        cpy Server.size
+        bne !loop-
   
         lda Server.version   
         jsr write
@@ -309,7 +1136,7 @@ identify: {
         
 done:   :input()
         
-        jmp irq.done
+        rts
 }
 
 //------------------------------------------------------------------------------
@@ -390,6 +1217,27 @@ eof:
 }
 
 	
+//------------------------------------------------------------------------------
+
+Data: {
+flags:   .byte $00
+timeout: .byte $00
+idle:    .byte $00
+far:     .byte $00 // $80 = via fetch/stash, $40 = direct
+config:  .byte $00
+cr:      .byte $00
+rcr:     .byte $00
+banks:   .byte $00
+last:    .word $0000
+value:   .byte $00
+length:  .byte $00
+count:   .word $0000
+offset:  .word $0000
+buffer:
+pattern: .fill 16, $00
+mask:    .fill 16, $00
+}
+
 //------------------------------------------------------------------------------
 
 readHeader: {
@@ -419,13 +1267,17 @@ write: {
 //------------------------------------------------------------------------------
 	
 Server:	{
-size:    .byte $05
-id:      .byte 'X', 'L', 'I', 'N', 'K'
+size:    .byte $09
+id:      .byte 'X', 'L', 'I', 'N', 'K', $00
+capabilities: .word Capability.hunt | Capability.compare | Capability.session | Capability.loadz | Capability.reu | Capability.fill | Capability.fast | Capability.linear | Capability.vdc | Capability.relocate | Capability.extension
+protocol: .byte protocolVersion
 start:	 .word install
-version: .byte $10
+version: .byte $11
 type:	 .byte $00 // 0 = RAM, 1 = ROM
 machine: .byte $01 // 0 = C64, 1 = C128
 end:	 .word *+2
 }
 
 //------------------------------------------------------------------------------
+
+relocations:            // relocation table appended by make-server
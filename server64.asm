@@ -4,6 +4,9 @@
 
 .pc = cmdLineVars.get("pc").asNumber()
 
+entry:	jmp install     // install the server
+	jmp overlay     // serve commands for the resident stub
+
 //------------------------------------------------------------------------------
 
 install: {
@@ -53,41 +56,75 @@ irq: {
 	ldy $dd01 // read command
 	:ack()   
 
-!next:	cpy #Command.load  // dispatch command
-	bne !next+
-	jmp load
+	jsr dispatch
 
-!next:	cpy #Command.save
-	bne !next+
-	jmp save
+done:   jsr jiffy
+	jmp sysirq+3
+}
 
-!next:	cpy #Command.peek
-	bne !next+
-	jmp peek
-	
-!next:	cpy #Command.poke
-	bne !next+
-	jmp poke
-	
-!next:	cpy #Command.jump
-	bne !next+
-	jmp jump
+//------------------------------------------------------------------------------
 
-!next:	cpy #Command.run
-	bne !next+
-	jmp run
+overlay: {              // injected by the stub, serve commands until END
+!loop:	:wait()
+	ldy $dd01
+	:ack()
 
-!next:	cpy #Command.inject
-	bne !next+
-	jmp inject
+	cpy #Command.ping
+	beq !loop-
+	cpy #Command.end
+	beq done
 
-!next:	cpy #Command.identify
-	bne !next+
+	jsr dispatch
+	jmp !loop-
+
+done:	rts
+}
+
+//------------------------------------------------------------------------------
+
+dispatch: {             // execute command in y
+	cpy #Command.extension
+	bcs !skip+
+
+	tya             // built-in command, jump via the command table
+	asl
+	tax
+	lda commands+1,x
+	pha
+	lda commands,x
+	pha
+	rts
+
+!skip:	cpy #Command.identify
+	bne !skip+
 	jmp identify
-        
-!next:	
-done:   jsr jiffy
-	jmp sysirq+3
+
+!skip:	cpy #Command.serve
+	bne !skip+
+	jmp vdisk.announce
+
+!skip:	:pushHandler(handlers)
+none:	rts
+
+commands:               // address-1 of each built-in command, by id
+	.word none-1    // $00 unused
+	.word load-1
+	.word save-1
+	.word poke-1
+	.word peek-1
+	.word jump-1
+	.word run-1
+	.word inject-1
+	.word hunt-1
+	.word compare-1
+	.word session-1
+	.word none-1    // end, only valid within a session
+	.word loadz-1
+	.word fill-1
+	.word relocate-1
+	.word register-1
+
+.if(* - commands != Command.extension * 2) .error "command table out of sync"
 }
 
 //------------------------------------------------------------------------------
@@ -95,7 +132,13 @@ done:   jsr jiffy
 load: {
 	jsr readHeader
 	:screenOff()
-	
+
+	bit bank        // load into REU?
+	bpl !skip+
+	jsr reu.load
+	:screenOn()
+	rts
+!skip:
 	:checkBasic()
 	
 	ldy #$00
@@ -126,7 +169,84 @@ slow:
 
 done:	:relinkBasic()
 	:screenOn()
-	jmp irq.done
+	rts
+}
+
+//------------------------------------------------------------------------------
+
+loadz: {                // load lz compressed data (see lz_compress in lz.c)
+	jsr readHeader
+	:screenOff()
+
+	:checkBasic()
+
+token:	jsr read        // literal run or back reference?
+	txa
+	bmi match
+
+	tax             // receive token+1 literal bytes
+	inx
+	stx Data.length
+
+	ldy #$00
+literal: :wait()
+	lda $dd01
+	ldx #$34        // write to ram with io disabled
+	stx $01
+	sta (start),y
+	ldx #$37
+	stx $01
+	:ack()
+	iny
+	cpy Data.length
+	bne literal
+	jmp advance
+
+match:	and #$7f        // copy token-$80+3 bytes from offset bytes back
+	clc
+	adc #$03
+	sta Data.length
+
+	jsr read stx Data.offset
+	jsr read stx Data.offset+1
+
+	sec
+	lda start
+	sbc Data.offset
+	sta copy+1
+	lda start+1
+	sbc Data.offset+1
+	sta copy+2
+
+	ldy #$00
+	ldx #$34        // read back what was written with io disabled
+	stx $01
+copy:	lda $ffff,y
+	sta (start),y
+	iny
+	cpy Data.length
+	bne copy
+	ldx #$37
+	stx $01
+
+advance: tya            // skip the decoded bytes
+	clc
+	adc start
+	sta start
+	bcc !skip+
+	inc start+1
+
+!skip:	lda start
+	cmp end
+	bne !next+
+	lda start+1
+	cmp end+1
+	beq done
+!next:	jmp token
+
+done:	:relinkBasic()
+	:screenOn()
+	rts
 }
 
 //------------------------------------------------------------------------------
@@ -136,6 +256,12 @@ save: {
 	:screenOff()
 	
         :output()
+
+	bit bank       // save from REU?
+	bpl !skip+
+	jsr reu.save
+	jmp done
+!skip:
 	ldy #$00
 
 	lda mem        // check if specific memory config was requested
@@ -162,7 +288,7 @@ done:	lda #$00   // reset CIA2 port B to input
 	sta $dd03
 	
 	:screenOn()
-	jmp irq.done
+	rts
 }
 
 //------------------------------------------------------------------------------
@@ -185,7 +311,7 @@ poke: {
 	lda #$37
 	sta $01
 
-	jmp irq.done
+	rts
 }
 
 //------------------------------------------------------------------------------
@@ -209,7 +335,7 @@ peek: {
 
 done:	:input()
 	
-	jmp irq.done
+	rts
 }
 
 //------------------------------------------------------------------------------
@@ -263,31 +389,452 @@ inject:	{
 	rts
 	
 return: nop
-	jmp irq.done
+	rts
+}
+
+//------------------------------------------------------------------------------
+
+hunt: {
+	jsr readHeader
+	jsr read stx Data.length
+
+	ldy #$00        // read pattern
+!loop:	jsr read txa
+	sta Data.pattern,y
+	iny
+	cpy Data.length
+	bne !loop-
+
+	ldy #$00        // read mask
+!loop:	jsr read txa
+	sta Data.mask,y
+	iny
+	cpy Data.length
+	bne !loop-
+
+	jsr read stx Data.count // maximum number of matches
+
+	sec             // stop where the pattern no longer fits
+	lda end
+	sbc Data.length
+	sta end
+	bcs !skip+
+	dec end+1
+!skip:	inc end
+	bne !skip+
+	inc end+1
+!skip:
+	:screenOff()
+	:output()
+
+	ldx mem         // search with requested memory config
+	stx $01
+	
+!loop:	ldy #$00
+match:	lda (start),y
+	eor Data.pattern,y
+	and Data.mask,y
+	bne miss
+	iny
+	cpy Data.length
+	bne match
+
+	lda #$37        // report match
+	sta $01
+	lda #$01 jsr write
+	lda start jsr write
+	lda start+1 jsr write
+
+	dec Data.count
+	beq done
+	
+	ldx mem
+	stx $01
+	
+miss:	:next()
+
+done:	lda #$37
+	sta $01
+	lda #$00 jsr write // no more matches
+
+	:input()
+	:screenOn()
+	rts
+}
+
+//------------------------------------------------------------------------------
+
+compare: {
+	jsr readHeader
+	:screenOff()
+
+	lda #$00
+	sta Data.count
+	sta Data.count+1
+
+	ldy #$00
+!loop:  :wait()
+	lda $dd01
+	ldx mem         // compare with requested memory config
+	stx $01
+	eor (start),y
+	ldx #$37
+	stx $01
+	tax
+	beq same
+
+	lda Data.count+1 // remember the first mismatches
+	bne count
+	lda Data.count
+	cmp #$10
+	bcs count
+	asl
+	tax
+	lda start
+	sta Data.buffer,x
+	lda start+1
+	sta Data.buffer+1,x
+
+count:	inc Data.count   // count all mismatches (saturated)
+	bne same
+	inc Data.count+1
+	bne same
+	dec Data.count
+	dec Data.count+1
+	
+same:	:ack()
+	:next()
+
+	:output()
+
+	lda Data.count jsr write
+	lda Data.count+1 jsr write
+
+	lda Data.count+1 // send the remembered mismatches
+	bne all
+	lda Data.count
+	cmp #$10
+	bcc some
+all:	lda #$10
+some:	asl
+	sta Data.length
+	beq done
+
+	ldy #$00
+!send:	lda Data.buffer,y
+	jsr write
+	iny
+	cpy Data.length
+	bne !send-
+	
+done:	:input()
+	:screenOn()
+	rts
+}
+
+//------------------------------------------------------------------------------
+
+fill: {
+	jsr readHeader
+	jsr read stx Data.value
+	:screenOff()
+
+	bit bank        // fill REU?
+	bpl ram
+	jsr reu.fill
+	jmp done
+
+ram:	ldx #$33        // write to ram with io disabled unless requested
+	lda mem
+	and #$7f
+	cmp #$37
+	bne !skip+
+	tax
+!skip:	stx $01
+
+	ldy #$00
+!loop:	lda Data.value
+	sta (start),y
+	:next()
+
+	lda #$37
+	sta $01
+
+done:	:screenOn()
+	:output()       // report completion, a large fill takes seconds
+	lda #$00
+	jsr write
+	:input()
+	rts
+}
+
+//------------------------------------------------------------------------------
+
+reu: {                  // REU transfers, mem holds the REU bank
+setup:	lda #<Data.value // each DMA moves one byte via Data.value
+	sta $df02
+	lda #>Data.value
+	sta $df03
+	lda start
+	sta $df04
+	lda start+1
+	sta $df05
+	lda mem
+	sta $df06
+	lda #$01
+	sta $df07
+	lda #$00
+	sta $df08
+	lda #$80        // fixed C64 address, REU address counts up
+	sta $df0a
+	rts
+
+load:	jsr setup
+!loop:  :wait()
+	lda $dd01
+	sta Data.value
+	:ack()
+	lda #$90        // stash
+	sta $df01
+	:next()
+	jmp done
+
+save:	jsr setup
+!loop:  lda #$91        // fetch
+	sta $df01
+	lda Data.value
+	:write()
+	:next()
+	jmp done
+
+fill:	jsr setup
+	sec             // a single DMA fills the whole range
+	lda end
+	sbc start
+	sta $df07
+	lda end+1
+	sbc start+1
+	sta $df08
+	lda #$90
+	sta $df01
+
+done:	lda #$00
+	sta $df0a
+	rts
+}
+
+//------------------------------------------------------------------------------
+
+session: {              // stay in a command loop until END or idle timeout
+	jsr read stx Data.flags
+	jsr read stx Data.timeout
+
+loop:	lda Data.flags  // keep screen blanked if requested
+	and #$01
+	beq wait
+	lda #$0b
+	sta $d011
+
+wait:	lda Data.timeout
+	sta Data.idle
+	ldx #$00
+	ldy #$00
+
+poll:	lda $dd0d       // wait for the next command
+	and #$10
+	bne command
+	dex
+	bne poll
+	dey
+	bne poll        // roughly one second per round
+	lda Data.timeout
+	beq poll        // no timeout
+	dec Data.idle
+	bne poll
+	beq done
+
+command: ldy $dd01
+	:ack()
+
+	cpy #Command.end
+	beq done
+	jsr dispatch
+	jmp loop
+
+done:	lda Data.flags
+	and #$01
+	beq exit
+	lda #$1b
+	sta $d011
+exit:	rts
 }
 
 //------------------------------------------------------------------------------
 
+relocate: {             // copy the server to the address received and patch it
+	jsr read stx end        // the new area must not overlap the server
+	jsr read stx end+1
+
+	lda Server.start
+	sta start
+	lda Server.start+1
+	sta start+1
+
+	sec                     // displacement of the copy
+	lda end
+	sbc start
+	sta Data.count
+	lda end+1
+	sbc start+1
+	sta Data.count+1
+
+	sec                     // size of the code and the relocation table
+	lda Server.end
+	sbc start
+	sta Data.offset
+	lda Server.end+1
+	sbc start+1
+	sta Data.offset+1
+
+	ldy #$00                // copy full pages...
+	ldx Data.offset+1
+	beq rest
+page:	lda (start),y
+	sta (end),y
+	iny
+	bne page
+	inc start+1
+	inc end+1
+	dex
+	bne page
+
+rest:	ldx Data.offset         // ...and the remaining bytes
+	beq copied
+!loop:	lda (start),y
+	sta (end),y
+	iny
+	dex
+	bne !loop-
+
+copied:	clc                     // start of the copy
+	lda Server.start
+	adc Data.count
+	sta Data.offset
+	lda Server.start+1
+	adc Data.count+1
+	sta Data.offset+1
+
+	lda #<[relocations+2]   // skip the table size
+	sta mem
+	lda #>[relocations+2]
+	sta mem+1
+
+patch:	ldy #$01                // add the displacement to each reference
+	lda (mem),y
+	cmp #$ff
+	beq done
+
+	jsr target              // low byte
+	ldy #$00
+	lda (start),y
+	clc
+	adc Data.count
+	sta (start),y
+	php
+
+	ldy #$03                // high byte
+	jsr target
+	ldy #$00
+	plp
+	lda (start),y
+	adc Data.count+1
+	sta (start),y
+
+	clc
+	lda mem
+	adc #$04
+	sta mem
+	bcc patch
+	inc mem+1
+	jmp patch
+
+done:	lda #<irq               // switch the irq and re-entry to the copy
+	ldx #>irq
+	jsr moved
+	sta $0314
+	stx $0315
+
+	lda #<install
+	ldx #>install
+	jsr moved
+	sta $03e9
+	stx $03ea
+
+	lda vdisk.device        // and the LOAD and SAVE hooks, if installed
+	beq !skip+
+	lda #<vdisk.load
+	ldx #>vdisk.load
+	jsr moved
+	sta $0330
+	stx $0331
+	lda #<vdisk.save
+	ldx #>vdisk.save
+	jsr moved
+	sta $0332
+	stx $0333
+!skip:
+
+	:output()               // report completion
+	lda #$00
+	jsr write
+	:input()
+	rts
+
+moved:	clc                     // add the displacement to a/x
+	adc Data.count
+	pha
+	txa
+	adc Data.count+1
+	tax
+	pla
+	rts
+
+target:	lda (mem),y             // start = copy + offset at y-1
+	tax
+	dey
+	lda (mem),y
+	clc
+	adc Data.offset
+	sta start
+	txa
+	adc Data.offset+1
+	sta start+1
+	rts
+}
+
+//------------------------------------------------------------------------------
+
+register: {             // register the handler for an extension command
+	:storeHandler(handlers)
+	rts
+}
+
+handlers: .fill extensions * 2, $00 // address-1 of each extension handler
+
+//------------------------------------------------------------------------------
+
 identify: {
         :output()
 
         lda Server.size
         jsr write
   
-        lda Server.id
-        jsr write
-
-        lda Server.id+1
-        jsr write
-
-        lda Server.id+2
-        jsr write
-
-        lda Server.id+3
-        jsr write
-
-        lda Server.id+4
+        ldy #$00       // id, followed by capabilities and protocol
+!loop:  lda Server.id,y
         jsr write
+        iny
+        cpy Server.size
+        bne !loop-
   
         lda Server.version   
         jsr write
@@ -318,7 +865,7 @@ identify: {
         
 done:   :input()
         
-        jmp irq.done
+        rts
 }
         
 //------------------------------------------------------------------------------	
@@ -347,13 +894,36 @@ write: {
 	rts
 }
 
+//------------------------------------------------------------------------------
+
+.import source "vdisk.asm"
+
+diskData: .fill 6, $00  // virtual disk device, original vectors and timer
+
+//------------------------------------------------------------------------------
+
+Data: {
+flags:   .byte $00
+timeout: .byte $00
+idle:    .byte $00
+length:  .byte $00
+count:   .word $0000
+offset:  .word $0000
+value:   .byte $00
+buffer:
+pattern: .fill 16, $00
+mask:    .fill 16, $00
+}
+
 //------------------------------------------------------------------------------
 	
 Server:	{
-size:    .byte $05
-id:      .byte 'X', 'L', 'I', 'N', 'K'
-start:	 .word install
-version: .byte $10
+size:    .byte $09
+id:      .byte 'X', 'L', 'I', 'N', 'K', $00
+capabilities: .word Capability.hunt | Capability.compare | Capability.session | Capability.loadz | Capability.reu | Capability.fill | Capability.relocate | Capability.extension | Capability.disk
+protocol: .byte protocolVersion
+start:	 .word entry
+version: .byte $11
 type:	 .byte $00 // 0 = RAM, 1 = ROM
 machine: .byte $00 // 0 = C64
 end:	 .word *+2
@@ -361,4 +931,4 @@ end:	 .word *+2
 
 //------------------------------------------------------------------------------	
 
-
+relocations:            // relocation table appended by make-server
@@ -0,0 +1,214 @@
+/* -*- mode: kasm -*- */
+
+// Minimal resident server. It only handles load, save, jump, run, inject
+// and identify, all other commands are served by the full server, which
+// the client injects as a transient overlay and removes again afterwards.
+//
+// Both areas are used up to the last byte, which is why the client hooks
+// the irq by loading its vector instead of injecting an install routine,
+// and sets the end of a loaded Basic program itself.
+
+.import source "server.h"
+
+.eval mem  = $bf        // header as received: mem, bank, start, end
+.eval bank = $c0
+
+//------------------------------------------------------------------------------
+// Tape buffer and unused space above it ($0334-$03ff)
+
+.pc = $0334
+
+irq: {                  // must stay first, the client hooks it here
+	lda $dd0d       // check for strobe from PC
+	and #$10
+	beq done        // no command
+
+	ldy $dd01       // read command
+	:ack()
+
+	jsr dispatch
+
+done:	jmp sysirq
+}
+
+//------------------------------------------------------------------------------
+
+dispatch: {             // execute command in y
+	cpy #Command.load
+	beq load
+	cpy #Command.save
+	beq save
+	cpy #Command.identify
+	beq identify
+	cpy #Command.inject
+	beq inject
+	cpy #Command.jump
+	beq jump
+	cpy #Command.run
+	bne load.done   // left to the full server
+}                       // run follows
+
+//------------------------------------------------------------------------------
+
+run: {                  // uninstall and run the Basic program
+	lda #<sysirq
+	sta $0314
+	lda #>sysirq
+	sta $0315
+	sty cursor      // cursor off, y holds the command
+
+	jsr insnewl     // reset the text pointer, clear variables and flush
+	sta mode        // the stack, returns with a = 0: flag program mode
+	jmp warmst
+}
+
+//------------------------------------------------------------------------------
+
+load: {
+	jsr header
+
+!loop:	jsr read
+	lda mem         // write with requested memory config
+	sta $01
+	txa
+	sta (start),y
+	lda #default
+	sta $01
+	jsr step
+	bne !loop-
+done:	rts
+}
+
+//------------------------------------------------------------------------------
+
+save: {
+	jsr header
+
+send:	:output()
+
+!loop:	lda mem         // read with requested memory config
+	sta $01
+	lda (start),y
+	ldx #default
+	stx $01
+	jsr write
+	jsr step
+	bne !loop-
+
+	lda #$00        // reset CIA2 port B to input
+	sta $dd03
+	rts
+}
+
+//------------------------------------------------------------------------------
+
+identify: {             // send the Server block like a save
+	ldy #$05
+!loop:	ldx range,y
+	stx mem,y
+	dey
+	bpl !loop-
+	iny
+	beq save.send
+
+range:	.byte default, $00
+	.word Server, Server.end
+}
+
+//------------------------------------------------------------------------------
+
+inject:	{
+	lda #>[done-1] pha // the injected code returns to the final rts
+	lda #<[done-1] pha
+
+	jsr read txa pha
+	jsr read txa pha
+
+done:	rts
+}
+
+//------------------------------------------------------------------------------
+
+jump: {
+	jsr read stx mem
+	jsr read        // bank is ignored on the C64
+
+	ldx #$ff txs    // reset stack pointer
+
+	lda #>repl     pha // make sure the code jumped to can rts to basic
+	lda #[<repl-1] pha
+
+	jsr read txa pha // push high byte of jump address
+	jsr read txa pha // push low byte of jump address
+
+	lda mem         // apply requested memory config
+	sta $01
+
+	lda #$00 tax tay pha // clear registers & push clean flags
+
+	rti             // jump via rti
+}
+
+.if(* > $0400) .error "stub exceeds the tape buffer"
+
+//------------------------------------------------------------------------------
+// Unused space below the system vectors ($02a7-$02ff)
+
+.pc = $02a7
+
+header: {               // read mem, bank, start and end, return with y=0
+	ldy #$00
+!loop:	jsr read
+	stx mem,y
+	iny
+	cpy #$06
+	bne !loop-
+	ldy #$00
+	rts
+}
+
+//------------------------------------------------------------------------------
+
+step: {                 // advance start, return with z set at end
+	inc start
+	bne !skip+
+	inc start+1
+!skip:	lda start
+	cmp end
+	bne done
+	lda start+1
+	cmp end+1
+done:	rts
+}
+
+//------------------------------------------------------------------------------
+
+read: {
+	:read()
+	rts
+}
+
+//------------------------------------------------------------------------------
+
+write: {
+	:write()
+	rts
+}
+
+//------------------------------------------------------------------------------
+
+Server:	{               // sent in the order expected by identify
+size:    .byte $09
+id:      .byte 'X', 'L', 'I', 'N', 'K', $00
+capabilities: .word Capability.overlay
+protocol: .byte protocolVersion
+version: .byte $11
+machine: .byte $00 // 0 = C64
+type:	 .byte $00 // 0 = RAM, 1 = ROM
+start:	 .word header
+stop:	 .word $0400
+memtop:	 .word $a000 // not tracked, overlays restore what they cover
+end:
+}
+
+.if(* > $0300) .error "stub exceeds the space below the system vectors"
@@ -1,9 +1,12 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <string.h>
 
 #include "range.h"
 #include "target.h"
+#include "lz.h"
+#include "disk.h"
 
 void check(bool condition, const char* message) {
   if(!condition) {
@@ -142,9 +145,237 @@ void test_range() {
   printf("passed range tests\n");
 }
 
+uint lz_decode(uchar* packed, uint length, uchar* data, uint size) {
+
+  // C model of the server's loadz: returns the number of bytes decoded,
+  // 0 if a token reaches outside the packed data or before the start
+  
+  uint in = 0;
+  uint out = 0;
+
+  while(out < size) {
+    if(in >= length) return 0;
+    
+    uchar token = packed[in++];
+
+    if(token & 0x80) {
+      if(in + 2 > length) return 0;
+      
+      uint count = (token & 0x7f) + XLINK_LZ_MIN_MATCH;
+      uint offset = packed[in] | packed[in+1] << 8;
+      in += 2;
+
+      if(offset == 0 || offset > out || out + count > size) return 0;
+
+      for(uint i=0; i<count; i++, out++) {
+        data[out] = data[out - offset]; // may read what was just written
+      }
+    }
+    else {
+      uint count = token + 1;
+
+      if(in + count > length || out + count > size) return 0;
+
+      memcpy(data + out, packed + in, count);
+      in += count;
+      out += count;
+    }
+  }
+  return in == length ? out : 0;
+}
+
+void test_lz_roundtrip(const char* name, uchar* data, uint size) {
+
+  uchar* packed = (uchar*) calloc(size + size/4 + 2, sizeof(uchar));
+  uchar* decoded = (uchar*) calloc(size + 1, sizeof(uchar));
+  uint tokens, matched;
+
+  uint length = lz_compress(data, size, packed, &tokens, &matched);
+
+  printf("Compressing %s: %d bytes to %d bytes, %d tokens\n", name, size, length, tokens);
+
+  check(length <= size + size/4 + 2, "Compressed data exceeds the worst case");
+  check(lz_decode(packed, length, decoded, size) == size, "Decoding failed...");
+  check(memcmp(data, decoded, size) == 0, "Decoded data differs...");
+
+  free(packed);
+  free(decoded);
+}
+
+void test_lz() {
+
+  uint size = 0x10000;
+  uchar* data = (uchar*) calloc(size, sizeof(uchar));
+  uchar packed[16];
+  uint tokens, matched;
+  uint seed = 1;
+  
+  // a run is a single literal followed by a back reference overlapping
+  // itself by all but one byte
+
+  memset(data, 0xaa, 300);
+
+  check(lz_compress(data, 300, packed, &tokens, &matched) == 2 + 3*3, "Run not packed into a literal and three back references");
+  check(packed[0] == 0x00 && packed[1] == 0xaa, "Run does not start with a single literal");
+  check(packed[2] == (0x80 | (XLINK_LZ_MAX_MATCH - XLINK_LZ_MIN_MATCH)) &&
+        packed[3] == 0x01 && packed[4] == 0x00, "Run not continued at offset 1");
+  check(matched == 299, "Run not matched after the first byte");
+  
+  test_lz_roundtrip("run", data, 300);
+
+  // a repeated pattern overlaps its back reference by a few bytes
+
+  for(uint i=0; i<1000; i++) data[i] = "xlink"[i % 5];
+  test_lz_roundtrip("pattern", data, 1000);
+
+  // noise only has literal runs, split at the longest run
+  
+  for(uint i=0; i<size; i++) {
+    seed = seed * 1103515245 + 12345;
+    data[i] = seed >> 16;
+  }
+  test_lz_roundtrip("noise", data, 1000);
+
+  uchar* literal = (uchar*) calloc(1000 + 1000/4 + 2, sizeof(uchar));
+  uint length = lz_compress(data, 1000, literal, &tokens, &matched);
+
+  check(tokens == (1000 + XLINK_LZ_MAX_LITERALS - 1) / XLINK_LZ_MAX_LITERALS &&
+        length == 1000 + tokens && literal[0] == XLINK_LZ_MAX_LITERALS - 1,
+        "Noise not split into literal runs of the maximum length");
+  free(literal);
+
+  // short inputs leave no room for a back reference
+
+  for(uint i=0; i<XLINK_LZ_MIN_MATCH+2; i++) {
+    test_lz_roundtrip("short", data, i);
+  }
+
+  // noise interleaved with earlier blocks, at offsets up to 64k
+
+  for(uint i=0x4000; i<size; i+=0x1000) {
+    memcpy(data+i, data + (i * 7 % (i - 0x100)), 0x100);
+  }
+  test_lz_roundtrip("mixed", data, size);
+
+  free(data);
+  printf("passed lz tests\n");
+}
+
+#define D64_SIZE 174848
+
+uchar* test_d64_sector(uchar* image, int track, int sector) {
+
+  // tracks 1-17 have 21 sectors each, which covers the directory track
+  
+  return image + ((track-1) * 21 + sector) * 256;
+}
+
+void test_d64_entry(uchar* entry, uchar type, int track, int sector, const char* name) {
+
+  entry[2] = type;
+  entry[3] = track;
+  entry[4] = sector;
+  memset(entry+5, 0xa0, 16);
+  memcpy(entry+5, name, strlen(name));
+}
+
+int test_d64_load(Disk* disk, const char* name, long* size) {
+
+  uchar buffer[256];
+  uchar* data;
+  
+  strcpy((char*) buffer, name); // disk_load strips the name in place
+  
+  int status = disk_load(disk, buffer, &data, size);
+
+  check(status == DISK_OK || data == NULL, "Failed load returned data");
+  free(data);
+  
+  return status;
+}
+
+void test_disk() {
+
+  Disk disk = { .path = "test.d64", .image = true, .size = D64_SIZE };
+  disk.data = (uchar*) calloc(D64_SIZE, sizeof(uchar));
+  
+  uchar* directory = test_d64_sector(disk.data, 18, 1);
+  uchar* first = test_d64_sector(disk.data, 1, 0);
+  uchar* last = test_d64_sector(disk.data, 1, 1);
+  uchar* loop = test_d64_sector(disk.data, 2, 0);
+  uchar name[] = "HELLO";
+  uchar* data;
+  long size;
+  
+  // HELLO spans two blocks, LOOP links to itself, NOTES is no PRG
+
+  directory[0] = 0;
+  directory[1] = 0xff;
+  
+  test_d64_entry(directory, 0x82, 1, 0, "HELLO");
+  test_d64_entry(directory+32, 0x82, 2, 0, "LOOP");
+  test_d64_entry(directory+64, 0x81, 1, 0, "NOTES");
+
+  first[0] = 1;
+  first[1] = 1;
+  memset(first+2, 0x11, 254);
+
+  last[0] = 0;
+  last[1] = 11;
+  memset(last+2, 0x22, 10);
+
+  loop[0] = 2;
+  loop[1] = 0;
+
+  check(disk_load(&disk, name, &data, &size) == DISK_OK,
+        "HELLO not loaded from d64");
+  check(size == 264 && data[0] == 0x11 && data[253] == 0x11 &&
+        data[254] == 0x22 && data[263] == 0x22, "HELLO not loaded from its sector chain");
+  free(data);
+  
+  check(test_d64_load(&disk, "0:HEL*,P,R", &size) == DISK_OK && size == 264,
+        "Drive prefix, wildcard and type suffix not handled");
+  check(test_d64_load(&disk, "H?LLO", &size) == DISK_OK, "Wildcard ? not matched");
+  check(test_d64_load(&disk, "HELL", &size) == DISK_FILE_NOT_FOUND, "Prefix HELL matched HELLO");
+  check(test_d64_load(&disk, "HELLO2", &size) == DISK_FILE_NOT_FOUND, "HELLO2 matched HELLO");
+  check(test_d64_load(&disk, "hello", &size) == DISK_FILE_NOT_FOUND, "d64 names matched without case");
+  check(test_d64_load(&disk, "NOTES", &size) == DISK_FILE_NOT_FOUND, "SEQ file loaded");
+  check(test_d64_load(&disk, "LOOP", &size) == DISK_FILE_NOT_FOUND, "Looping sector chain loaded");
+  check(test_d64_load(&disk, "", &size) == DISK_MISSING_NAME, "Empty name not rejected");
+  check(test_d64_load(&disk, "0:", &size) == DISK_MISSING_NAME, "Empty name after drive not rejected");
+
+  check(disk_save(&disk, name, first, 10) == DISK_NOT_OUTPUT, "Saved to d64");
+
+  // a directory chain that links to itself ends the search
+  
+  directory[0] = 18;
+  directory[1] = 1;
+
+  check(test_d64_load(&disk, "MISSING", &size) == DISK_FILE_NOT_FOUND, "Looping directory searched");
+  
+  free(disk.data);
+
+  // PETSCII names as typed in the default character set
+  
+  char ascii[8];
+
+  disk_name((uchar*) "HELLO", ascii, sizeof(ascii));
+  check(strcmp(ascii, "hello") == 0, "Unshifted letters not mapped to lower case");
+
+  disk_name((uchar*) "\xc1" "B/\x01", ascii, sizeof(ascii));
+  check(strcmp(ascii, "Ab__") == 0, "Shifted letters or special characters not mapped");
+
+  disk_name((uchar*) "LONGFILENAME", ascii, sizeof(ascii));
+  check(strcmp(ascii, "longfil") == 0, "Name not truncated to the buffer size");
+  
+  printf("passed disk tests\n");
+}
+
 int main(int argc, char** argv) {
   test_target();
   test_range();
+  test_lz();
+  test_disk();
 
   exit(EXIT_SUCCESS);
 }
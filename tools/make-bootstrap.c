@@ -3,6 +3,21 @@
 #include <string.h>
 #include <sys/stat.h>
 
+// The code is stored as string literals in DATA lines, each character
+// holding six bits. The alphabet consists of characters that can be
+// typed directly and never need quoting: 0-9, :;<=>?@, unshifted and
+// shifted letters. The loader maps the PETSCII code c back to c-48, or
+// to c-150 for shifted letters (c-48 > 42).
+
+#define CHARS_PER_LINE 56 // 42 bytes, keeps the line below 80 columns
+
+static char encode(int value) {
+  if(value < 10) return '0' + value;
+  if(value < 17) return ':' + value - 10;
+  if(value < 43) return 'a' + value - 17;
+  return 'A' + value - 43;
+}
+
 int main(int argc, char **argv) {
   
   FILE *f;
@@ -32,7 +47,7 @@ int main(int argc, char **argv) {
 
   stat(filename, &st);
   size = st.st_size-2;
-  size = size + (8-(size % 8));
+  size = size + (3-(size % 3)) % 3;
 
   unsigned char *data = (unsigned char*) calloc(size, sizeof(char));
 
@@ -45,11 +60,19 @@ int main(int argc, char **argv) {
     printf("%d print chr$(14)\n", l+=10);
   }
   printf("%d print\"please wait...\":print\n", l+=10);
-  printf("%d d=%d:s=%d:c=0:l=1000:m=0\n", l+=10, address, size);
-  printf("%d for i=0 to s-1:for k=0 to 7\n", l+=10);
-  printf("%d read v:poke d+i+k,v:c=c+v:next k\n", l+=10);
-  printf("%d read v:if c<>v then print\"data checksum error on line\";l:end\n", l+=10);
-  printf("%d c=0:l=l+1:i=i+7:nexti\n", l+=10);
+  printf("%d d=%d:l=1000\n", l+=10, address);
+
+  int next = l+10;     // decode the next line of data...
+  int done = next+70;  // ...until the empty string at the end
+  
+  printf("%d read a$,v:if a$=\"\" then %d\n", l+=10, done);
+  printf("%d c=0:for j=1 to len(a$) step 4:w=0:for k=0 to 3\n", l+=10);
+  printf("%d b=asc(mid$(a$,j+k,1))-48:w=w*64+b+102*(b>42):next k\n", l+=10);
+  printf("%d x=int(w/65536):y=int(w/256)-x*256:z=w-int(w/256)*256\n", l+=10);
+  printf("%d poke d,x:poke d+1,y:poke d+2,z:d=d+3:c=c+x+y+z:next j\n", l+=10);
+  printf("%d if c<>v then print\"data checksum error on line\";l:end\n", l+=10);
+  printf("%d l=l+1:goto %d\n", l+=10, next);
+
   printf("%d print\"on your pc, please run\":print\n", l+=10);
 
   if(strcmp(machine, "c64") == 0) {
@@ -72,24 +95,26 @@ int main(int argc, char **argv) {
   printf("%d end\n", l+=10);
   l = 1000;
 
-  for(int i=0; i<size; i++) {
-    if (i%8 == 0) {
-      
-      if(checksum) {
-        printf("%d\n", checksum);
-      }
-      printf("%d data ", l);
-      
-      checksum=0;
-      l++;
+  // four characters per three bytes, followed by the line's checksum
+  
+  for(int i=0; i<size; i+=3) {
+    if (i % (CHARS_PER_LINE/4*3) == 0) {
+      printf("%d data \"", l++);
+      checksum = 0;
     }
-    printf("%d,", data[i]);
-    checksum += data[i];
+    int value = data[i] << 16 | data[i+1] << 8 | data[i+2];
+    
+    for(int k=18; k>=0; k-=6) {
+      printf("%c", encode((value >> k) & 0x3f));
+    }
+    checksum += data[i] + data[i+1] + data[i+2];
 
-    if(i==size-1 && i%8 != 0) {
-      printf("%d\n", checksum);
+    if((i+3) % (CHARS_PER_LINE/4*3) == 0 || i+3 >= size) {
+      printf("\",%d\n", checksum);
     }
   }
+  printf("%d data \"\",0\n", l);
+  
   free(data);
        
   return EXIT_SUCCESS;
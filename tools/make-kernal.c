@@ -64,6 +64,7 @@ int main(int argc, char **argv) {
 
   int numPatches = argc/2;
   int offset, size;
+  int total = 0;
   
   printf("void xlink_kernal_%s(unsigned char* image) {\n", name);
 
@@ -78,7 +79,13 @@ int main(int argc, char **argv) {
   for(int i=0; i<numPatches; i++) {
     offset = strtol(argv[i*2], NULL, 0);
     size = strtol(argv[i*2+1], NULL, 0);
+    total += size;
 
+    // report the size of each patched region, so that growing code is
+    // noticed before it runs into the next kernal routine
+    
+    fprintf(stderr, "%s: $%04X-$%04X: %4d bytes\n", name, 0xe000+offset, 0xe000+offset+size, size);
+    
     printf("patches[%d] = &(Patch) {\n", i);
     printf("  .offset = %d,\n", offset);
     printf("  .size = %d,\n", size);
@@ -98,6 +105,8 @@ int main(int argc, char **argv) {
   printf("}\n");
   
   printf("}\n");
+
+  fprintf(stderr, "%s: %d bytes patched in %d regions\n", name, total, numPatches);
   
  done: 
   free(code);
@@ -50,9 +50,15 @@ int main(int argc, char **argv) {
   unsigned char *high   = (unsigned char *) calloc(1, sizeof(unsigned char));
   unsigned char *low    = (unsigned char *) calloc(1, sizeof(unsigned char));
   unsigned char *loader = (unsigned char *) calloc(1, sizeof(unsigned char));
+
+  // "-s" only prints the size of the server and its relocation table
+  // (without load address), as required for assembling the loader
+  
+  bool sizeonly = argc > 0 && strcmp(name, "-s") == 0;
   
-  if(argc < 4) {
+  if(argc < (sizeonly ? 4 : 5)) {
     fprintf(stderr, "usage: make-server <name> <base> <low> <high> <loader>\n");
+    fprintf(stderr, "       make-server -s <base> <low> <high>\n");
     goto done;
   }
 
@@ -65,7 +71,7 @@ int main(int argc, char **argv) {
   if(!load(argv[3], &high))
     goto done;  
 
-  if(!load(argv[4], &loader))
+  if(!sizeonly && !load(argv[4], &loader))
     goto done;  
   
   stat(argv[1], &st);
@@ -83,8 +89,12 @@ int main(int argc, char **argv) {
     goto done;
   }
 
-  stat(argv[4], &st);
-  int loader_size = st.st_size;
+  int loader_size = 0;
+
+  if(!sizeonly) {
+    stat(argv[4], &st);
+    loader_size = st.st_size;
+  }
   
   int count = 0;
   address** table = (address**) calloc(count, sizeof(address*));
@@ -106,9 +116,16 @@ int main(int argc, char **argv) {
   }
 
   int index=0;
+
+  // low and high bytes are paired in order, so every reference must
+  // differ in both assemblies
   
   for(int i=0; i<size; i++) {
     if(base[i] != high[i]) {
+      if(index == count) {
+        fprintf(stderr, "error: high byte at offset %d has no matching low byte\n", i);
+        goto done;
+      }
       addr = table[index];
       addr->delta = (((base[i]-1) << 8) | addr->delta);
       addr->msb = i;
@@ -116,6 +133,25 @@ int main(int argc, char **argv) {
     }
   }
 
+  if(index != count) {
+    fprintf(stderr, "error: %d low bytes but %d high bytes differ\n", count, index);
+    goto done;
+  }
+
+  // the relocation table is appended to the server, so that it can
+  // relocate itself: a word holding the table size, followed by the
+  // offsets of the low and high byte of each reference and $ffff; the
+  // first reference is the load address and not part of the server
+  
+  int table_size = 2 + (count-1) * 4 + 2;
+  int total = size + table_size;
+
+  if(sizeonly) {
+    printf("%d\n", total-2);
+    result = EXIT_SUCCESS;
+    goto done;
+  }
+
   printf("#include <stdlib.h>\n");
   printf("#include \"xlink.h\"\n");
   printf("#include \"machine.h\"\n");  
@@ -134,7 +170,7 @@ int main(int argc, char **argv) {
   printf("loader[1] = hi(machine->default_basic_start);\n");
   printf("sprintf((char*)loader+7, \"%%d\", machine->default_basic_start+0x10);\n");
   
-  printf("unsigned char* code = xlink_server_%s(0x4000-%d+2, size);\n", name, size);
+  printf("unsigned char* code = xlink_server_%s(0x4000-%d+2, size);\n", name, total);
   printf("unsigned char* result = (unsigned char*) calloc((*size)+%d-2, sizeof(unsigned char));\n", loader_size);
 
   printf("for(int i=0; i<%d; i++) { result[i] = loader[i]; }\n", loader_size);
@@ -147,27 +183,41 @@ int main(int argc, char **argv) {
   
   printf("unsigned char* xlink_server_%s(unsigned short address, int *size) {\n", name);
 
-  printf("(*size) = %d;\n", size);
+  printf("(*size) = %d;\n", total);
 
-  printf("if(address+%d > 0x10000) {\n", size);
+  printf("if(address+%d > 0x10000) {\n", total);
   printf("   SET_ERROR(XLINK_ERROR_SERVER, \"Can't create server: out of memory\");\n");
   printf("   return NULL;\n");
   printf("}\n");
   
-  printf("unsigned char code[%d] = { ", size);
+  printf("unsigned char code[%d] = { ", total);
 
   for(int i=0; i<size; i++) {
     printf("%d,", base[i]);
   }
-  printf(" };\n");
 
-  printf("unsigned char* result = (unsigned char*) calloc(%d, sizeof(unsigned char));\n", size);
+  printf("%d,%d,", table_size & 0xff, table_size >> 8);
+
+  for(int i=1; i<count; i++) {
+    addr = table[i];
+    printf("%d,%d,", (addr->lsb-2) & 0xff, (addr->lsb-2) >> 8);
+    printf("%d,%d,", (addr->msb-2) & 0xff, (addr->msb-2) >> 8);
+  }
+  printf("255,255, };\n");
+
+  printf("unsigned char* result = (unsigned char*) calloc(%d, sizeof(unsigned char));\n", total);
   printf("unsigned short dest;\n");
   
-  printf("for(int i=0; i<%d; i++) { result[i] = code[i]; };\n", size);
+  printf("for(int i=0; i<%d; i++) { result[i] = code[i]; };\n", total);
 
   for(int i=0; i<count; i++) {
     addr = table[i];
+
+    // the server ends with its end address, which has to cover the table
+
+    if(addr->lsb == size-2 && addr->msb == size-1) {
+      addr->delta += table_size;
+    }
     printf("dest = address+%d;\n", addr->delta);
     printf("result[%d] = (unsigned char) (dest & 0xff);\n", addr->lsb);
     printf("result[%d] = (unsigned char) (dest >> 8);\n", addr->msb);    
@@ -0,0 +1,46 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+int main(int argc, char **argv) {
+
+  struct stat st;
+  int size, i;
+  FILE* f;
+
+  if(argc < 3) {
+    fprintf(stderr, "usage: make-stub <name> <prg>\n");
+    return EXIT_FAILURE;
+  }
+
+  char *name = argv[1];
+  char *filename = argv[2];
+
+  if((f = fopen(filename, "rb")) == NULL) {
+    fprintf(stderr, "%s: error opening %s\n", argv[0], filename);
+    return EXIT_FAILURE;
+  }
+
+  stat(filename, &st);
+  size = st.st_size;
+
+  printf("#include <stdlib.h>\n");
+  printf("unsigned char* xlink_stub_%s(int *size);\n", name);
+  printf("unsigned char* xlink_stub_%s(int *size) {\n", name);
+  printf("(*size) = %d;\n", size);
+
+  printf("unsigned char code[%d] = { ", size);
+  for(i=0; i<size; i++) {
+    printf("%d,", fgetc(f));
+  }
+  printf(" };\n");
+
+  printf("unsigned char* result = (unsigned char*) calloc(%d, sizeof(unsigned char));\n", size);
+  printf("for(int i=0; i<%d; i++) { result[i] = code[i]; };\n", size);
+  printf("return result;\n");
+  printf("}\n");
+
+  fclose(f);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,239 @@
+/* -*- mode: kasm -*- */
+
+// Virtual disk (C64): once the host announces a device via the serve
+// command, LOAD and SAVE for that device are forwarded to the host.
+// Requests the host does not pick up within a few seconds, or other
+// devices, go to the routines the vectors pointed to before.
+//
+// The including server defines diskData, six bytes of RAM holding the
+// device (0 = none), the original LOAD and SAVE vectors and a timer. The
+// hooks run within the program's own LOAD and SAVE and leave its zero
+// page alone, apart from the kernal's transfer addresses.
+
+vdisk: {
+
+.label device  = diskData
+.label vectors = diskData+1
+.label timer   = diskData+5
+
+//------------------------------------------------------------------------------
+
+announce: {             // serve poll while no request is pending
+	jsr read        // device announced by the host, 0 = none
+	lda device
+	stx device
+	bne hooked
+
+	txa             // keep the current vectors and hook them
+	beq reply
+	ldx #$03
+!loop:	lda $0330,x
+	sta vectors,x
+	dex
+	bpl !loop-
+
+	lda #<load
+	ldx #>load
+	sta $0330
+	stx $0331
+	lda #<save
+	ldx #>save
+	sta $0332
+	stx $0333
+	jmp reply
+
+hooked:	txa
+	bne reply
+	jsr unhook
+
+reply:	:output()
+	lda #Serve.none
+	jsr write
+	:input()
+	rts
+}
+
+//------------------------------------------------------------------------------
+
+unhook: {               // restore the original vectors
+	ldx #$03
+!loop:	lda vectors,x
+	sta $0330,x
+	dex
+	bpl !loop-
+	lda #$00
+	sta device
+	rts
+}
+
+//------------------------------------------------------------------------------
+
+load: {                 // LOAD via $0330, a = 0: load, 1: verify
+	ldx $ba
+	cpx device
+	bne kernal
+	tax             // verify is left to the original routine
+	bne kernal
+
+	php
+	sei
+	lda $c3         // address used for secondary address 0
+	sta start
+	lda $c4
+	sta start+1
+
+	lda #Serve.load
+	jsr request
+	bcs timeout
+
+	:input()
+	jsr read        // status, 0 or a kernal error code
+	txa
+	bne failed
+
+	jsr read stx start  // address and end chosen by the host
+	jsr read stx start+1
+	jsr read stx end
+	jsr read stx end+1
+
+	ldy #$00
+!loop:	:wait()
+	lda $dd01
+	sta (start),y
+	:ack()
+	:next()
+
+	ldx end         // return the end address like the kernal
+	ldy end+1
+	stx $ae
+	sty $af
+	lda #$00
+	sta $90
+
+failed:	plp
+	cmp #$01        // carry set on error
+	rts
+
+timeout: plp
+	lda #$00
+kernal:	ldx #$00        // original LOAD
+	jmp chain
+}
+
+//------------------------------------------------------------------------------
+
+save: {                 // SAVE via $0332, range in $c1/$c2 and $ae/$af
+	ldx $ba
+	cpx device
+	bne kernal
+
+	php
+	sei
+	lda $ae
+	sta end
+	lda $af
+	sta end+1
+
+	lda #Serve.save
+	jsr request
+	bcs timeout
+
+	lda start       // empty range, nothing to send
+	cmp end
+	bne !skip+
+	lda start+1
+	cmp end+1
+	beq sent
+
+!skip:	ldy #$00
+!loop:	lda (start),y
+	:write()
+	:next()
+
+sent:	:input()
+	jsr read        // status, 0 or a kernal error code
+	txa
+	plp
+	cmp #$01        // carry set on error
+	rts
+
+timeout: plp
+kernal:	ldx #$02        // original SAVE
+	jmp chain
+}
+
+//------------------------------------------------------------------------------
+
+chain: {                // continue at original vector x, keeping a
+	tay             // (jmp indirect would fail on a page boundary)
+	lda vectors+1,x
+	pha
+	lda vectors,x
+	pha
+	php
+	tya
+	rti
+}
+
+//------------------------------------------------------------------------------
+
+request: {              // wait for the host's serve poll, then send request a
+	pha
+	lda #$03        // give up after a few seconds
+	sta timer
+	ldx #$00
+	ldy #$00
+
+poll:	lda $dd0d
+	and #$10
+	bne command
+	dex
+	bne poll
+	dey
+	bne poll
+	dec timer
+	bne poll
+
+	pla             // the host is gone, stop redirecting the device
+	jsr unhook
+	sec
+	rts
+
+command: ldy $dd01
+	:ack()
+	cpy #Command.serve
+	bne poll        // e.g. ping
+	jsr read        // device, already known
+
+	:output()
+	pla
+	jsr write       // type, device, secondary address, range, name
+	lda $ba
+	jsr write
+	lda $b9
+	jsr write
+	lda start
+	jsr write
+	lda start+1
+	jsr write
+	lda end
+	jsr write
+	lda end+1
+	jsr write
+	lda $b7
+	jsr write
+
+	ldy #$00
+name:	cpy $b7
+	beq done
+	lda ($bb),y
+	jsr write
+	iny
+	bne name
+
+done:	clc
+	rts
+}
+
+eof:
+}
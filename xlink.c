@@ -10,17 +10,56 @@
 #include "target.h"
 #include "driver/driver.h"
 #include "util.h"
+#include "lz.h"
 
 #if windows
   #include <windows.h>
 #endif
 
 #define XLINK_DEFAULT_TIMEOUT  0x01
+#define XLINK_SEARCH_TIMEOUT   0x05
 #define XLINK_GO64 0xff4d
 
+#define XLINK_MAX_PATTERN      16   // longest pattern supported by hunt
+#define XLINK_MAX_MATCHES      255  // matches reported per hunt command
+#define XLINK_MAX_MISMATCHES   16   // mismatches reported per compare command
+#define XLINK_REU_BANK_SIZE    0x10000
+#define XLINK_LINEAR_SIZE      0x20000 // both C128 RAM banks
+#define XLINK_LINEAR_TOP       0xff00  // MMU registers and vectors of each bank above
+#define XLINK_LINEAR_SHARED    0x0400  // bank 1 below is bank 0 common RAM
+#define XLINK_VDC_SIZE         0x10000
+#define XLINK_OVERLAY_ENTRY    0x03 // offset of the overlay entry in the server
+#define XLINK_IRQ_VECTOR       0x0314
+
+#define XLINK_LZ_TOKEN_CYCLES  80   // remote cycles spent decoding a token
+#define XLINK_LZ_MATCH_CYCLES  24   // remote cycles spent copying a matched byte
+#define XLINK_REMOTE_CLOCK     985248.0
+
+#define XLINK_DEFAULT_LINK_SPEED (50*1024.0) // bytes per second until measured
+#define XLINK_MIN_MEASURED       1024        // shortest transfer used to measure
+
 Driver* driver;
 xlink_error_t* xlink_error;
 
+static uchar compression = XLINK_COMPRESSION_NONE;
+static double link_speed = XLINK_DEFAULT_LINK_SPEED;
+
+static struct {
+  uchar* backup;   // memory covered by the active overlay
+  ushort address;
+  uint size;
+} overlay;
+
+static struct {
+  bool valid;      // until the server may have been replaced
+  xlink_server_info_t info;
+} identified;
+
+static bool server_identify(xlink_server_info_t* server);
+static bool server_supports(ushort capability);
+static void server_forget(void);
+static bool inject(ushort address);
+
 //------------------------------------------------------------------------------
 
 unsigned char xlink_version(void) {
@@ -58,6 +97,9 @@ void libxlink_initialize() {
   driver->reset   = &_driver_reset;
   driver->boot    = &_driver_boot;
   driver->free    = &_driver_free;
+  driver->transact = &_driver_transact;
+  driver->loopback = &_driver_loopback;
+  driver->stats    = &_driver_stats;
 
   driver->_open = &_driver_setup_and_open;
 
@@ -93,6 +135,7 @@ void libxlink_finalize(void) {
 //------------------------------------------------------------------------------
 
 bool xlink_set_device(char* path) {
+  server_forget();
   return driver_setup(path);
 }  
 
@@ -104,6 +147,13 @@ char* xlink_get_device(void) {
 
 //------------------------------------------------------------------------------
 
+bool xlink_devices(xlink_device_t* devices, int max, int* count) {
+  (*count) = device_enumerate(devices, max);
+  return true;
+}
+
+//------------------------------------------------------------------------------
+
 bool xlink_has_device(void) {
   bool result;
   
@@ -152,6 +202,20 @@ bool xlink_identify(xlink_server_info_t* server) {
     }
     
     server->id[size] = '\0';
+
+    // newer servers append capabilities and protocol version to the
+    // zero-terminated id, older clients only see the id
+
+    int length = strlen(server->id);
+    
+    if(size >= length + 4) {
+      server->capabilities = ((uchar) server->id[length+1]) | ((uchar) server->id[length+2]) << 8;
+      server->protocol = server->id[length+3];
+    }
+    else {
+      server->capabilities = 0;
+      server->protocol = 0x01;
+    }
     
     server->version = data[0];
     server->machine = data[1];
@@ -171,6 +235,9 @@ bool xlink_identify(xlink_server_info_t* server) {
     
     server->length = server->end - server->start;   
 
+    memcpy(&identified.info, server, sizeof(xlink_server_info_t));
+    identified.valid = true;
+    
     driver->close();
     result = true;
   }
@@ -199,9 +266,35 @@ bool xlink_ping() {
 
 //------------------------------------------------------------------------------
 
+bool xlink_loopback(bool enabled) {
+  bool result = false;
+  if(driver->open()) {
+    result = driver->loopback(enabled);
+    driver->close();
+  }
+  CLEAR_ERROR_IF(result);
+  return result;
+}
+
+//------------------------------------------------------------------------------
+
+bool xlink_stats(xlink_stats_t* stats, bool clear) {
+  bool result = false;
+  if(driver->open()) {
+    result = driver->stats(stats, clear);
+    driver->close();
+  }
+  CLEAR_ERROR_IF(result);
+  return result;
+}
+
+//------------------------------------------------------------------------------
+
 bool xlink_reset(void) {
 
   bool result = false;
+
+  server_forget();
   
   if(driver->open()) {
     driver->reset();
@@ -320,16 +413,32 @@ bool xlink_bootloader(void) {
 
 //------------------------------------------------------------------------------
 
-bool xlink_load(unsigned char memory, 
-                unsigned char bank, 
-                unsigned short address, 
-                unsigned char* data,
-                unsigned int size) {
+static void measure(Watch* watch, uint size) {
+
+  // keep a running estimate of the raw link speed to decide whether
+  // compressing a transfer pays off
+  
+  double seconds = watch_elapsed(watch) / 1000.0;
+
+  if(size >= XLINK_MIN_MEASURED && seconds > 0) {
+    link_speed = (link_speed + size / seconds) / 2;
+    logger->debug("estimated link speed: %.2f kb/s", link_speed / 1024);
+  }
+}
+
+//------------------------------------------------------------------------------
+
+static bool load_plain(unsigned char memory, 
+                       unsigned char bank, 
+                       unsigned short address, 
+                       unsigned char* data,
+                       unsigned int size) {
 
   bool result = false;
   unsigned short start = address;
   unsigned short end = start + size;
-
+  Watch* watch = watch_new();
+  
   if(driver->open()) {
     
     if(!driver->ping()) {
@@ -341,13 +450,18 @@ bool xlink_load(unsigned char memory,
     if(!driver->send((unsigned char []) {XLINK_COMMAND_LOAD, memory, bank, 
             lo(start), hi(start), lo(end), hi(end)}, 7)) goto error;
 
+    watch_start(watch);
+    
     if(!driver->send(data, size)) goto error;
 
+    measure(watch, size);
+    
     driver->close();
     result = true;
   }
 
  done:
+  watch_free(watch);
   CLEAR_ERROR_IF(result);
   return result;
 
@@ -358,31 +472,29 @@ bool xlink_load(unsigned char memory,
 
 //------------------------------------------------------------------------------
 
-bool xlink_save(unsigned char memory, 
-                unsigned char bank, 
-                unsigned short address, 
-                unsigned char* data,
-		unsigned int size) {
-  
+static bool load_compressed(unsigned char memory, 
+                            unsigned char bank, 
+                            unsigned short address, 
+                            unsigned char* packed,
+                            unsigned int length,
+                            unsigned int size) {
+
   bool result = false;
   unsigned short start = address;
   unsigned short end = start + size;
 
   if(driver->open()) {
-
+    
     if(!driver->ping()) {
       SET_ERROR(XLINK_ERROR_SERVER, "no response from server");
       goto error;
     }
 
-    driver->output();
-    if(!driver->send((unsigned char []) {XLINK_COMMAND_SAVE, memory, bank, 
+    driver->output();    
+    if(!driver->send((unsigned char []) {XLINK_COMMAND_LOADZ, memory, bank, 
             lo(start), hi(start), lo(end), hi(end)}, 7)) goto error;
 
-    driver->input();
-    driver->strobe();
-
-    if(!driver->receive(data, size)) goto error;
+    if(!driver->send(packed, length)) goto error;
 
     driver->close();
     result = true;
@@ -399,119 +511,141 @@ bool xlink_save(unsigned char memory,
 
 //------------------------------------------------------------------------------
 
-bool xlink_peek(unsigned char memory, 
-		unsigned char bank, 
-		unsigned short address, 
-		unsigned char* value) {
-
-  bool result = false;
-  
-  if(driver->open()) {
-  
-    if(!driver->ping()) {
-      SET_ERROR(XLINK_ERROR_SERVER, "no response from server");
-      goto error;
-    }
-
-    driver->output();
-    if(!driver->send((unsigned char []) {XLINK_COMMAND_PEEK,
-            memory, bank, lo(address), hi(address)}, 5)) goto error;
-    
-    driver->input();
-    driver->strobe();
+static bool stub_relink(ushort address, uint size) {
 
-    if(!driver->receive(value, 1)) goto error;
+  // the stub has no room for the server's check for Basic programs, so
+  // set the end of the program text from here, as the server would
 
-    driver->close();
-    result = true;
+  uchar start[2];
+  ushort end = address + size;
+  
+  if(!xlink_save(machine->memory, machine->bank, machine->basic_start, start, 2)) {
+    return false;
   }
 
- done:
-  CLEAR_ERROR_IF(result);
-  return result;
-
- error:
-  driver->close();
-  goto done;
+  if((start[0] | start[1] << 8) != address) {
+    return true;
+  }
+  return load_plain(machine->memory, machine->bank, machine->basic_end,
+                    (uchar []) { lo(end), hi(end) }, 2);
 }
 
 //------------------------------------------------------------------------------
 
-bool xlink_poke(unsigned char memory, 
-		unsigned char bank, 
-		unsigned short address, 
-		unsigned char value) {
+static bool load_auto(unsigned char memory, 
+                      unsigned char bank, 
+                      unsigned short address, 
+                      unsigned char* data,
+                      unsigned int size) {
 
   bool result = false;
+  xlink_server_info_t server;
+  uint tokens, matched;
+
+  if(compression == XLINK_COMPRESSION_NONE || size < XLINK_LZ_MIN_MATCH ||
+     (bank & (XLINK_BANK_REU|XLINK_BANK_VDC))) {
+    return load_plain(memory, bank, address, data, size);
+  }
   
-  if(driver->open()) {
+  // worst case: single literals separated by minimal back references
   
-    if(!driver->ping()) {
-      SET_ERROR(XLINK_ERROR_SERVER, "no response from server");
-      goto error;
-    }
-    
-    driver->output();
-    if(!driver->send((unsigned char []) {XLINK_COMMAND_POKE, memory, bank, 
-            lo(address), hi(address), value}, 6)) goto error;    
+  uchar* packed = (uchar*) calloc(size + size/4 + 2, sizeof(uchar));
+  uint length = lz_compress(data, size, packed, &tokens, &matched);
 
-    driver->close();
-    result = true;
+  double plain = size / link_speed;
+  double compressed = length / link_speed +
+    (tokens * XLINK_LZ_TOKEN_CYCLES + matched * XLINK_LZ_MATCH_CYCLES) / XLINK_REMOTE_CLOCK;
+  
+  logger->debug("compressed %d to %d bytes, estimated %.3fs instead of %.3fs",
+                size, length, compressed, plain);
+  
+  if(compression == XLINK_COMPRESSION_AUTO && compressed >= plain) {
+    goto plain;
   }
 
- done:
-  CLEAR_ERROR_IF(result);
-  return result;
+  if(!server_identify(&server) || !(server.capabilities & XLINK_CAPABILITY_LOADZ)) {
+    logger->debug("server does not support compressed transfers");
+    goto plain;
+  }
 
- error:
-  driver->close();
+  // back references read what was written before, so leave transfers
+  // that would write to i/o registers to the plain load
+
+  bool io = server.machine == XLINK_MACHINE_C64 ?
+    (memory & 0x7f) == 0x37 : !(memory & 0x01);
+  
+  if(io && address < 0xe000 && address + size > 0xd000) {
+    logger->debug("not compressing transfer into i/o area");
+    goto plain;
+  }
+  
+  result = load_compressed(memory, bank, address, packed, length, size);
   goto done;
+  
+ plain:
+  result = load_plain(memory, bank, address, data, size);
+
+ done:
+  free(packed);
+  return result;
 }
 
 //------------------------------------------------------------------------------
 
-bool xlink_fill(unsigned char memory,
-		unsigned char bank,
-		unsigned short address,
-		unsigned char value,
-		unsigned int size) {
+bool xlink_load(unsigned char memory, 
+                unsigned char bank, 
+                unsigned short address, 
+                unsigned char* data,
+                unsigned int size) {
 
-  bool result = false;
+  if(!load_auto(memory, bank, address, data, size)) {
+    return false;
+  }
 
-  uchar* data = (uchar*) calloc(size, sizeof(uchar));
-  memset(data, value, size);
+  if(!(bank & (XLINK_BANK_REU|XLINK_BANK_VDC)) && server_supports(XLINK_CAPABILITY_OVERLAY)) {
+    return stub_relink(address, size);
+  }
+  return true;
+}
 
-  result = xlink_load(memory, bank, address, data, size);
+//------------------------------------------------------------------------------
 
-  free(data);
-  return result;
+void xlink_set_compression(uchar mode) {
+  compression = mode;
 }
 
 //------------------------------------------------------------------------------
 
-bool xlink_jump(unsigned char memory, 
-		unsigned char bank, 
-		unsigned short address) {
-
+bool xlink_save(unsigned char memory, 
+                unsigned char bank, 
+                unsigned short address, 
+                unsigned char* data,
+		unsigned int size) {
+  
   bool result = false;
-
-  // jump address is send MSB first (big-endian)    
+  unsigned short start = address;
+  unsigned short end = start + size;
 
   if(driver->open()) {
-  
+
     if(!driver->ping()) {
       SET_ERROR(XLINK_ERROR_SERVER, "no response from server");
       goto error;
     }
-    
+
     driver->output();
-    if(!driver->send((unsigned char []) {XLINK_COMMAND_JUMP, memory, bank, 
-          hi(address), lo(address)}, 5)) goto error;
+    if(!driver->send((unsigned char []) {XLINK_COMMAND_SAVE, memory, bank, 
+            lo(start), hi(start), lo(end), hi(end)}, 7)) goto error;
 
-    driver->close();    
+    driver->input();
+    driver->strobe();
+
+    if(!driver->receive(data, size)) goto error;
+
+    driver->close();
     result = true;
   }
-  
+
  done:
   CLEAR_ERROR_IF(result);
   return result;
@@ -523,24 +657,26 @@ bool xlink_jump(unsigned char memory,
 
 //------------------------------------------------------------------------------
 
-bool xlink_run(void) {
+bool xlink_peek(unsigned char memory, 
+		unsigned char bank, 
+		unsigned short address, 
+		unsigned char* value) {
 
   bool result = false;
+
+  if(server_supports(XLINK_CAPABILITY_OVERLAY)) {
+    return xlink_save(memory, bank, address, value, 1); // the stub has no peek
+  }
   
-   if(driver->open()) {
+  if(driver->open()) {
   
-    if(!driver->ping()) {
-      SET_ERROR(XLINK_ERROR_SERVER, "no response from server");
-      goto error;
-    }
-
-    driver->output();
-    if(!driver->send((unsigned char []) {XLINK_COMMAND_RUN}, 1)) goto error;
+    if(!driver->transact(true, (unsigned char []) {XLINK_COMMAND_PEEK,
+            memory, bank, lo(address), hi(address)}, 5, value, 1)) goto error;
 
     driver->close();
     result = true;
   }
-   
+
  done:
   CLEAR_ERROR_IF(result);
   return result;
@@ -552,36 +688,26 @@ bool xlink_run(void) {
 
 //------------------------------------------------------------------------------
 
-bool xlink_inject(ushort address, uchar* code, uint size) {
+bool xlink_poke(unsigned char memory, 
+		unsigned char bank, 
+		unsigned short address, 
+		unsigned char value) {
 
   bool result = false;
-  uchar memory = machine->memory;
-  uchar bank = machine->bank;
-  
-  if(!xlink_load(memory, bank, address, code, size)) {
-    goto done;
+
+  if(server_supports(XLINK_CAPABILITY_OVERLAY)) {
+    return load_auto(memory, bank, address, &value, 1); // the stub has no poke
   }
   
   if(driver->open()) {
   
-    if(!driver->ping()) {
-      SET_ERROR(XLINK_ERROR_SERVER, "no response from server");
-      goto error;      
-    }
-  
-    // send the address-1 high byte first, so the server can 
-    // just push it on the stack and rts
-    
-    address--;
+    if(!driver->transact(true, (unsigned char []) {XLINK_COMMAND_POKE, memory, bank, 
+            lo(address), hi(address), value}, 6, NULL, 0)) goto error;
 
-    driver->output();
-    if(!driver->send((unsigned char []) {XLINK_COMMAND_INJECT,
-            hi(address), lo(address)}, 3)) goto error;
-    
     driver->close();
     result = true;
   }
-  
+
  done:
   CLEAR_ERROR_IF(result);
   return result;
@@ -593,42 +719,1089 @@ bool xlink_inject(ushort address, uchar* code, uint size) {
 
 //------------------------------------------------------------------------------
 
-void xlink_begin() {
-  driver->state = XLINK_DRIVER_STATE_IDLE;
-}
+static bool server_identify(xlink_server_info_t* server) {
 
-//------------------------------------------------------------------------------
+  // identify once per server instead of before each command, the result
+  // is forgotten whenever the server may have been replaced
+  
+  if(identified.valid) {
+    memcpy(server, &identified.info, sizeof(xlink_server_info_t));
+    return true;
+  }
 
-bool xlink_send(uchar* data, uint size) {
+  logger->suspend();
+  bool result = xlink_identify(server);
+  logger->resume();
 
-  bool result = false;
+  return result;
+}
 
-  if(driver->open()) {
+//------------------------------------------------------------------------------
 
-    if(driver->state == XLINK_DRIVER_STATE_INPUT) {
-      driver->wait(0);
-    }
-    driver->output();
-    driver->state = XLINK_DRIVER_STATE_OUTPUT;
+static void server_forget(void) {
+  identified.valid = false;
+}
 
-    if(!driver->send(data, size)) goto error;
+//------------------------------------------------------------------------------
 
-    driver->close();
-    result = true;
-  }
+static bool server_supports(ushort capability) {
 
- done:  
-  CLEAR_ERROR_IF(result);
-  return result;
+  xlink_server_info_t server;
 
- error:
-  driver->close();
-  goto done;
+  return server_identify(&server) && (server.capabilities & capability) == capability;
 }
 
 //------------------------------------------------------------------------------
 
-bool xlink_send_with_timeout(uchar* data, uint size, uint timeout) {
+static bool overlay_place(uint start, uint end, uint size, ushort* address) {
+
+  // prefer the free area below I/O, then the Basic area up to its ROM
+
+  int areas[][2] = { { machine->free_ram_area, machine->io >> 16 },
+                     { machine->default_basic_start, machine->lorom >> 16 } };
+
+  for(int i=0; i<2; i++) {
+    int lo = areas[i][0];
+    int hi = areas[i][1];
+    int candidates[] = { lo, hi - (int) size, (int) end, (int) start - (int) size };
+
+    for(int k=0; k<4; k++) {
+      int first = candidates[k];
+      int last = first + size;
+
+      if(first < lo || last > hi) continue;
+      if(last > (int) start && first < (int) end) continue;
+
+      *address = first;
+      return true;
+    }
+  }
+  return false;
+}
+
+//------------------------------------------------------------------------------
+
+static bool overlay_begin(uint start, uint end) {
+
+  bool result = false;
+  uchar* code = NULL;
+  ushort address;
+  int size;
+
+  free(machine->server(0x0000, &size));
+  size -= 2;
+
+  if(!overlay_place(start, end, size, &address)) {
+    SET_ERROR(XLINK_ERROR_SERVER, "no room for an overlay outside $%04X-$%04X", start, end);
+    goto done;
+  }
+
+  logger->debug("loading overlay to $%04X-$%04X", address, address + size);
+
+  overlay.backup = (uchar*) calloc(size, sizeof(uchar));
+  overlay.address = address;
+  overlay.size = size;
+
+  if(!xlink_save(machine->memory, machine->bank, address, overlay.backup, size)) goto done;
+
+  code = machine->server(address, &size);
+
+  if(!load_auto(machine->memory, machine->bank, address, code+2, size-2)) goto done;
+
+  result = inject(address + XLINK_OVERLAY_ENTRY);
+
+ done:
+  if(!result) {
+    free(overlay.backup);
+    overlay.backup = NULL;
+  }
+  free(code);
+  CLEAR_ERROR_IF(result);
+  return result;
+}
+
+//------------------------------------------------------------------------------
+
+static bool overlay_end(bool result) {
+
+  xlink_error_t error;
+  bool restored;
+
+  if(overlay.backup == NULL) {
+    return result;
+  }
+
+  memcpy(&error, xlink_error, sizeof(xlink_error_t));
+
+  // END returns from the overlay to the stub, which then restores the
+  // memory covered by the overlay
+
+  restored = xlink_session_end() &&
+    load_auto(machine->memory, machine->bank, overlay.address, overlay.backup, overlay.size);
+
+  free(overlay.backup);
+  overlay.backup = NULL;
+
+  if(!restored) {
+    return false;
+  }
+
+  if(!result) {
+    memcpy(xlink_error, &error, sizeof(xlink_error_t));
+  }
+  return result;
+}
+
+//------------------------------------------------------------------------------
+
+static bool server_provides(ushort capability, uint start, uint end) {
+
+  if(server_supports(XLINK_CAPABILITY_OVERLAY)) {
+
+    // the resident stub lacks the handler, bring in the full server
+
+    return (machine->overlays & capability) == capability &&
+      overlay_begin(start, end);
+  }
+  return server_supports(capability);
+}
+
+//------------------------------------------------------------------------------
+
+static bool fill_remote(uchar memory, uchar bank, ushort address, uchar value, uint size) {
+
+  bool result = false;
+  unsigned short start = address;
+  unsigned short end = start + size;
+  uchar done;
+
+  if(driver->open()) {
+    
+    if(!driver->ping()) {
+      SET_ERROR(XLINK_ERROR_SERVER, "no response from server");
+      goto error;
+    }
+
+    driver->output();    
+    if(!driver->send((unsigned char []) {XLINK_COMMAND_FILL, memory, bank, 
+            lo(start), hi(start), lo(end), hi(end), value}, 8)) goto error;
+
+    // wait until the server has filled the range, which takes seconds
+    // for large ranges
+    
+    driver->input();
+    driver->strobe();
+
+    driver->timeout = XLINK_SEARCH_TIMEOUT;
+    if(!driver->receive(&done, 1)) goto error;
+    driver->timeout = XLINK_DEFAULT_TIMEOUT;
+
+    driver->close();
+    result = true;
+  }
+
+ done:
+  CLEAR_ERROR_IF(result);
+  return result;
+
+ error:
+  driver->timeout = XLINK_DEFAULT_TIMEOUT;
+  driver->close();
+  goto done;
+}
+
+//------------------------------------------------------------------------------
+
+bool xlink_fill(unsigned char memory,
+		unsigned char bank,
+		unsigned short address,
+		unsigned char value,
+		unsigned int size) {
+
+  bool result = false;
+
+  // the server fills from start until it reaches end, an empty range
+  // would wrap around and fill all 64k
+
+  if(size == 0 || address + size > 0x10000) {
+    SET_ERROR(XLINK_ERROR_SERVER, "fill range out of bounds: $%04X-$%05X",
+              address, address + size);
+    return false;
+  }
+  
+  if(server_supports(XLINK_CAPABILITY_FILL)) {
+    return fill_remote(memory, bank, address, value, size);
+  }
+  
+  uchar* data = (uchar*) calloc(size, sizeof(uchar));
+  memset(data, value, size);
+
+  result = load_auto(memory, bank, address, data, size);
+
+  free(data);
+  return result;
+}
+
+//------------------------------------------------------------------------------
+
+static bool reu_supported(void) {
+
+  if(!server_supports(XLINK_CAPABILITY_REU)) {
+    SET_ERROR(XLINK_ERROR_SERVER, "server does not support REU transfers");
+    return false;
+  }
+  return true;
+}
+
+//------------------------------------------------------------------------------
+
+bool xlink_reu_load(uint address, uchar* data, uint size) {
+
+  bool result = reu_supported();
+
+  // the server addresses one 64k REU bank per transfer
+  
+  while(result && size > 0) {
+    uint chunk = XLINK_REU_BANK_SIZE - (address & 0xffff);
+    if(chunk > size) chunk = size;
+
+    result = xlink_load(address >> 16, XLINK_BANK_REU, address & 0xffff, data, chunk);
+
+    address += chunk;
+    data += chunk;
+    size -= chunk;
+  }
+  
+  CLEAR_ERROR_IF(result);
+  return result;
+}
+
+//------------------------------------------------------------------------------
+
+bool xlink_reu_save(uint address, uchar* data, uint size) {
+
+  bool result = reu_supported();
+
+  while(result && size > 0) {
+    uint chunk = XLINK_REU_BANK_SIZE - (address & 0xffff);
+    if(chunk > size) chunk = size;
+
+    result = xlink_save(address >> 16, XLINK_BANK_REU, address & 0xffff, data, chunk);
+
+    address += chunk;
+    data += chunk;
+    size -= chunk;
+  }
+  
+  CLEAR_ERROR_IF(result);
+  return result;
+}
+
+//------------------------------------------------------------------------------
+
+bool xlink_reu_fill(uint address, uchar value, uint size) {
+
+  bool result = reu_supported();
+
+  while(result && size > 0) {
+    uint chunk = XLINK_REU_BANK_SIZE - (address & 0xffff);
+    if(chunk > size) chunk = size;
+
+    result = xlink_fill(address >> 16, XLINK_BANK_REU, address & 0xffff, value, chunk);
+
+    address += chunk;
+    size -= chunk;
+  }
+  
+  CLEAR_ERROR_IF(result);
+  return result;
+}
+
+//------------------------------------------------------------------------------
+
+static bool vdc_supported(uint address, uint size) {
+
+  if(size == 0 || address + size > XLINK_VDC_SIZE) {
+    SET_ERROR(XLINK_ERROR_SERVER, "VDC range out of bounds: $%05X-$%05X",
+              address, address + size);
+    return false;
+  }
+
+  if(!server_supports(XLINK_CAPABILITY_VDC)) {
+    SET_ERROR(XLINK_ERROR_SERVER, "server does not support VDC transfers");
+    return false;
+  }
+  return true;
+}
+
+//------------------------------------------------------------------------------
+
+bool xlink_vdc_load(uint address, uchar* data, uint size) {
+  return vdc_supported(address, size) &&
+    xlink_load(0x00, XLINK_BANK_VDC, address, data, size);
+}
+
+//------------------------------------------------------------------------------
+
+bool xlink_vdc_save(uint address, uchar* data, uint size) {
+  return vdc_supported(address, size) &&
+    xlink_save(0x00, XLINK_BANK_VDC, address, data, size);
+}
+
+//------------------------------------------------------------------------------
+
+bool xlink_vdc_fill(uint address, uchar value, uint size) {
+  return vdc_supported(address, size) &&
+    xlink_fill(0x00, XLINK_BANK_VDC, address, value, size);
+}
+
+//------------------------------------------------------------------------------
+
+static bool transfer_linear(uchar command, uint address, uchar* data, uint size) {
+
+  bool result = false;
+
+  // both banks are used up to the MMU registers; bank 1 starts above the
+  // common RAM it shares with bank 0, so the server skips from one to
+  // the other when crossing banks
+  
+  uint stop = address + size;
+  uint top = 0x10000 + XLINK_LINEAR_TOP;
+  uint above = 0x10000 + XLINK_LINEAR_SHARED;
+
+  if(address > above) above = address;
+  
+  uint low = address < XLINK_LINEAR_TOP ?
+    (stop < XLINK_LINEAR_TOP ? stop : XLINK_LINEAR_TOP) - address : 0;
+  uint high = stop > above && above < top ?
+    (stop < top ? stop : top) - above : 0;
+
+  if(size == 0 || address + size > XLINK_LINEAR_SIZE) {
+    SET_ERROR(XLINK_ERROR_SERVER, "linear range out of bounds: $%05X-$%05X",
+              address, address + size);
+    goto done;
+  }
+
+  if(low + high == 0) {
+    SET_ERROR(XLINK_ERROR_SERVER, "linear range only covers MMU registers or common RAM: $%05X-$%05X",
+              address, address + size);
+    goto done;
+  }
+  
+  if(!server_supports(XLINK_CAPABILITY_LINEAR)) {
+    SET_ERROR(XLINK_ERROR_SERVER, "server does not support linear transfers");
+    goto done;
+  }
+
+  unsigned short start = (low ? address : above) & 0xffff;
+  unsigned short end = (high ? above + high : address + low) & 0xffff;
+  uchar banks = (low ? 0x00 : 0x01) | (high ? 0x10 : 0x00);
+
+  if(low + high < size) {
+    logger->debug("skipping MMU registers and common RAM in $%05X-$%05X", address, address + size);
+  }
+  
+  if(driver->open()) {
+    
+    if(!driver->ping()) {
+      SET_ERROR(XLINK_ERROR_SERVER, "no response from server");
+      goto error;
+    }
+
+    driver->output();    
+    if(!driver->send((unsigned char []) {command, banks, XLINK_BANK_LINEAR, 
+            lo(start), hi(start), lo(end), hi(end)}, 7)) goto error;
+
+    if(command == XLINK_COMMAND_LOAD) {
+      if(low && !driver->send(data, low)) goto error;
+      if(high && !driver->send(data + (above - address), high)) goto error;
+    }
+    else {
+      memset(data, 0, size);
+      
+      driver->input();
+      driver->strobe();
+
+      if(low && !driver->receive(data, low)) goto error;
+      if(high && !driver->receive(data + (above - address), high)) goto error;
+    }
+    
+    driver->close();
+    result = true;
+  }
+
+ done:
+  CLEAR_ERROR_IF(result);
+  return result;
+
+ error:
+  driver->close();
+  goto done;
+}
+
+//------------------------------------------------------------------------------
+
+bool xlink_load_linear(uint address, uchar* data, uint size) {
+  return transfer_linear(XLINK_COMMAND_LOAD, address, data, size);
+}
+
+//------------------------------------------------------------------------------
+
+bool xlink_save_linear(uint address, uchar* data, uint size) {
+  return transfer_linear(XLINK_COMMAND_SAVE, address, data, size);
+}
+
+//------------------------------------------------------------------------------
+
+static bool hunt_remote(uchar memory, uchar bank, ushort address, uint size,
+                        uchar* pattern, uchar* mask, uchar length,
+                        ushort* matches, uchar max, uint* count) {
+
+  bool result = false;
+  unsigned short start = address;
+  unsigned short end = start + size;
+  uchar found;
+  uchar match[2];
+
+  *count = 0;
+  
+  if(driver->open()) {
+
+    if(!driver->ping()) {
+      SET_ERROR(XLINK_ERROR_SERVER, "no response from server");
+      goto error;
+    }
+
+    driver->output();
+    if(!driver->send((unsigned char []) {XLINK_COMMAND_HUNT, memory, bank,
+            lo(start), hi(start), lo(end), hi(end), length}, 8)) goto error;
+
+    if(!driver->send(pattern, length)) goto error;
+    if(!driver->send(mask, length)) goto error;
+    if(!driver->send(&max, 1)) goto error;
+
+    driver->input();
+    driver->strobe();
+
+    // each match is announced separately while the server keeps searching
+
+    driver->timeout = XLINK_SEARCH_TIMEOUT;
+    
+    while(true) {
+      if(!driver->receive(&found, 1)) goto error;
+      if(!found) break;
+
+      if(!driver->receive(match, 2)) goto error;
+      matches[(*count)++] = match[0] | match[1] << 8;
+    }
+
+    driver->timeout = XLINK_DEFAULT_TIMEOUT;
+    driver->close();
+    result = true;
+  }
+
+ done:
+  CLEAR_ERROR_IF(result);
+  return result;
+
+ error:
+  driver->timeout = XLINK_DEFAULT_TIMEOUT;
+  driver->close();
+  goto done;
+}
+
+//------------------------------------------------------------------------------
+
+static bool hunt_local(uchar memory, uchar bank, ushort address, uint size,
+                       uchar* pattern, uchar* mask, uint length,
+                       ushort* matches, uint max, uint* count) {
+
+  uchar* data = (uchar*) calloc(size, sizeof(uchar));
+  bool result;
+  
+  if((result = xlink_save(memory, bank, address, data, size))) {
+    
+    for(uint i=0; i+length <= size && *count < max; i++) {
+      uint k;
+      
+      for(k=0; k<length; k++) {
+        if((data[i+k] ^ pattern[k]) & mask[k]) break;
+      }      
+      if(k == length) {
+        matches[(*count)++] = address + i;
+      }
+    }
+  }
+  free(data);
+  return result;
+}
+
+//------------------------------------------------------------------------------
+
+bool xlink_hunt(uchar memory, uchar bank, ushort address, uint size,
+                uchar* pattern, uchar* mask, uint length,
+                ushort* matches, uint max, uint* count) {
+
+  bool result = false;
+  uchar all[XLINK_MAX_PATTERN];
+  uint found;
+  
+  *count = 0;
+
+  if(length == 0 || length > XLINK_MAX_PATTERN) {
+    SET_ERROR(XLINK_ERROR_SERVER, "pattern length must be between 1 and %d bytes",
+              XLINK_MAX_PATTERN);
+    goto done;
+  }
+
+  if(mask == NULL) {
+    memset(all, 0xff, length);
+    mask = all;
+  }
+
+  if(size < length || max == 0) {
+    result = true;
+    goto done;
+  }
+  
+  if(!server_provides(XLINK_CAPABILITY_HUNT, address, address + size)) {
+    logger->debug("server does not support hunt, searching locally");
+    result = hunt_local(memory, bank, address, size, pattern, mask, length, matches, max, count);
+    goto done;
+  }
+
+  while(*count < max) {
+
+    uchar batch = (max - *count) > XLINK_MAX_MATCHES ? XLINK_MAX_MATCHES : max - *count;
+    
+    if(!(result = hunt_remote(memory, bank, address, size, pattern, mask, length,
+                              matches + *count, batch, &found))) break;
+
+    *count += found;
+
+    if(found < batch) break;
+
+    // more matches requested, continue right after the last one
+    
+    uint skip = (ushort) (matches[*count-1] - address) + 1;
+
+    if(skip + length > size) break;
+
+    address += skip;
+    size -= skip;
+  }
+
+  result = overlay_end(result);
+  
+ done:
+  CLEAR_ERROR_IF(result);
+  return result;
+}
+
+//------------------------------------------------------------------------------
+
+static bool compare_remote(uchar memory, uchar bank, ushort address, uchar* data, uint size,
+                           ushort* mismatches, uint* reported, uint* count) {
+
+  bool result = false;
+  unsigned short start = address;
+  unsigned short end = start + size;
+  uchar total[2];
+  uchar reports[XLINK_MAX_MISMATCHES*2];
+  
+  if(driver->open()) {
+
+    if(!driver->ping()) {
+      SET_ERROR(XLINK_ERROR_SERVER, "no response from server");
+      goto error;
+    }
+
+    driver->output();
+    if(!driver->send((unsigned char []) {XLINK_COMMAND_COMPARE, memory, bank,
+            lo(start), hi(start), lo(end), hi(end)}, 7)) goto error;
+
+    if(!driver->send(data, size)) goto error;
+
+    driver->input();
+    driver->strobe();
+
+    if(!driver->receive(total, 2)) goto error;
+
+    *count = total[0] | total[1] << 8;
+    *reported = *count > XLINK_MAX_MISMATCHES ? XLINK_MAX_MISMATCHES : *count;
+
+    if(*reported) {
+      if(!driver->receive(reports, *reported * 2)) goto error;
+    }
+    
+    for(uint i=0; i<*reported; i++) {
+      mismatches[i] = reports[i*2] | reports[i*2+1] << 8;
+    }
+    
+    driver->close();
+    result = true;
+  }
+
+ done:
+  CLEAR_ERROR_IF(result);
+  return result;
+
+ error:
+  driver->close();
+  goto done;
+}
+
+//------------------------------------------------------------------------------
+
+static bool compare_local(uchar memory, uchar bank, ushort address, uchar* data, uint size,
+                          ushort* mismatches, uint max, uint* count) {
+
+  uchar* remote = (uchar*) calloc(size, sizeof(uchar));
+  bool result;
+  
+  if((result = xlink_save(memory, bank, address, remote, size))) {
+    
+    for(uint i=0; i<size; i++) {
+      if(data[i] != remote[i]) {
+        if(*count < max) {
+          mismatches[*count] = address + i;
+        }
+        (*count)++;
+      }
+    }
+  }
+  free(remote);
+  return result;
+}
+
+//------------------------------------------------------------------------------
+
+bool xlink_compare(uchar memory, uchar bank, ushort address, uchar* data, uint size,
+                   ushort* mismatches, uint max, uint* count) {
+  
+  bool result = false;
+  ushort reports[XLINK_MAX_MISMATCHES];
+  uint reported;
+  uint rest = 0;
+  
+  *count = 0;
+
+  if(size == 0) {
+    result = true;
+    goto done;
+  }
+  
+  if(!server_provides(XLINK_CAPABILITY_COMPARE, address, address + size)) {
+    logger->debug("server does not support compare, comparing locally");
+    result = compare_local(memory, bank, address, data, size, mismatches, max, count);
+    goto done;
+  }
+
+  if(!(result = compare_remote(memory, bank, address, data, size, reports, &reported, count))) {
+    goto done;
+  }
+  
+  for(uint i=0; i<reported && i<max; i++) {
+    mismatches[i] = reports[i];
+  }
+
+  // the server only reports the first few mismatches, fetch the
+  // remaining part of the range if more have been requested
+  
+  if(*count > reported && max > reported) {
+
+    uint skip = (ushort) (reports[reported-1] - address) + 1;
+
+    result = compare_local(memory, bank, address + skip, data + skip, size - skip,
+                           mismatches + reported, max - reported, &rest);
+  }
+  
+ done:
+  result = overlay_end(result);
+  CLEAR_ERROR_IF(result);
+  return result;
+}
+
+//------------------------------------------------------------------------------
+
+bool xlink_jump(unsigned char memory, 
+		unsigned char bank, 
+		unsigned short address) {
+
+  bool result = false;
+
+  // jump address is send MSB first (big-endian)    
+
+  server_forget();
+  
+  if(driver->open()) {
+  
+    if(!driver->transact(true, (unsigned char []) {XLINK_COMMAND_JUMP, memory, bank, 
+          hi(address), lo(address)}, 5, NULL, 0)) goto error;
+
+    driver->close();    
+    result = true;
+  }
+  
+ done:
+  CLEAR_ERROR_IF(result);
+  return result;
+
+ error:
+  driver->close();
+  goto done;
+}
+
+//------------------------------------------------------------------------------
+
+bool xlink_run(void) {
+
+  bool result = false;
+
+  server_forget(); // the server removes itself
+  
+   if(driver->open()) {
+  
+    if(!driver->ping()) {
+      SET_ERROR(XLINK_ERROR_SERVER, "no response from server");
+      goto error;
+    }
+
+    driver->output();
+    if(!driver->send((unsigned char []) {XLINK_COMMAND_RUN}, 1)) goto error;
+
+    driver->close();
+    result = true;
+  }
+   
+ done:
+  CLEAR_ERROR_IF(result);
+  return result;
+
+ error:
+  driver->close();
+  goto done;
+}
+
+//------------------------------------------------------------------------------
+
+bool xlink_inject(ushort address, uchar* code, uint size) {
+
+  bool result = false;
+  uchar memory = machine->memory;
+  uchar bank = machine->bank;
+  
+  if(!load_auto(memory, bank, address, code, size)) {
+    goto done;
+  }
+
+  result = inject(address);
+
+ done:
+  server_forget();
+  CLEAR_ERROR_IF(result);
+  return result;
+}
+
+//------------------------------------------------------------------------------
+
+static bool inject(ushort address) {
+
+  bool result = false;
+  
+  if(driver->open()) {
+  
+    if(!driver->ping()) {
+      SET_ERROR(XLINK_ERROR_SERVER, "no response from server");
+      goto error;      
+    }
+  
+    // send the address-1 high byte first, so the server can 
+    // just push it on the stack and rts
+    
+    address--;
+
+    driver->output();
+    if(!driver->send((unsigned char []) {XLINK_COMMAND_INJECT,
+            hi(address), lo(address)}, 3)) goto error;
+    
+    driver->close();
+    result = true;
+  }
+  
+ done:
+  CLEAR_ERROR_IF(result);
+  return result;
+
+ error:
+  driver->close();
+  goto done;
+}
+
+//------------------------------------------------------------------------------
+
+bool xlink_register_handler(uchar command, ushort address, uchar* code, uint size) {
+
+  bool result = false;
+
+  if(command < XLINK_COMMAND_EXTENSION ||
+     command >= XLINK_COMMAND_EXTENSION + XLINK_EXTENSIONS) {
+    SET_ERROR(XLINK_ERROR_SERVER, "invalid extension command: 0x%02X", command);
+    goto done;
+  }
+
+  if(!server_supports(XLINK_CAPABILITY_EXTENSION)) {
+    SET_ERROR(XLINK_ERROR_SERVER, "server does not support extension commands");
+    goto done;
+  }
+
+  if(address != 0 && size > 0) {
+    if(!load_auto(machine->memory, machine->bank, address, code, size)) {
+      goto done;
+    }
+  }
+
+  // like inject, the server expects address-1 high byte first, so it
+  // can push it on the stack and rts
+  
+  if(address != 0) address--;
+  
+  if(driver->open()) {
+  
+    if(!driver->ping()) {
+      SET_ERROR(XLINK_ERROR_SERVER, "no response from server");
+      goto error;      
+    }
+  
+    driver->output();
+    if(!driver->send((unsigned char []) {XLINK_COMMAND_REGISTER, command,
+            hi(address), lo(address)}, 4)) goto error;
+    
+    driver->close();
+    result = true;
+  }
+  
+ done:
+  CLEAR_ERROR_IF(result);
+  return result;
+
+ error:
+  driver->close();
+  goto done;
+}
+
+//------------------------------------------------------------------------------
+
+bool xlink_serve_poll(uchar device, xlink_request_t* request) {
+
+  bool result = false;
+  uchar header[8];
+
+  memset(request, 0, sizeof(xlink_request_t));
+  
+  if(driver->open()) {
+
+    if(!driver->ping()) {
+      SET_ERROR(XLINK_ERROR_SERVER, "no response from server");
+      goto error;
+    }
+
+    driver->output();
+    if(!driver->send((unsigned char []) {XLINK_COMMAND_SERVE, device}, 2)) goto error;
+
+    driver->input();
+    driver->strobe();
+
+    if(!driver->receive(&request->type, 1)) goto error;
+
+    if(request->type != XLINK_SERVE_NONE) {
+
+      // device, secondary address, start, end, name length and name
+      
+      if(!driver->receive(header, 8)) goto error;
+
+      request->device    = header[1];
+      request->secondary = header[2];
+      request->start     = header[3] | header[4] << 8;
+      request->end       = header[5] | header[6] << 8;
+      request->length    = header[7];
+      
+      if(!driver->receive(request->name, request->length)) goto error;
+
+      if(request->type == XLINK_SERVE_SAVE && request->end > request->start) {
+        uint size = request->end - request->start;
+        request->data = (uchar*) calloc(size, sizeof(uchar));
+
+        if(!driver->receive(request->data, size)) goto error;
+      }
+    }
+    
+    driver->close();
+    result = true;
+  }
+
+ done:
+  CLEAR_ERROR_IF(result);
+  return result;
+
+ error:
+  driver->close();
+  goto done;
+}
+
+//------------------------------------------------------------------------------
+
+static bool serve_reply(uchar status, ushort address, uchar* data, uint size) {
+
+  bool result = false;
+  
+  if(driver->open()) {
+
+    // the program is waiting for the reply, there is no ping
+    
+    driver->output();
+    if(!driver->send(&status, 1)) goto error;
+
+    if(data != NULL) {
+      ushort end = address + size;
+      
+      if(!driver->send((unsigned char []) {lo(address), hi(address),
+              lo(end), hi(end)}, 4)) goto error;
+      
+      if(!driver->send(data, size)) goto error;
+    }
+    
+    driver->close();
+    result = true;
+  }
+
+ done:
+  CLEAR_ERROR_IF(result);
+  return result;
+
+ error:
+  driver->close();
+  goto done;
+}
+
+//------------------------------------------------------------------------------
+
+bool xlink_serve_load(uchar status, ushort address, uchar* data, uint size) {
+
+  if(status == 0 && (size == 0 || address + size > 0x10000)) {
+    status = 4; // file not found
+  }
+  return serve_reply(status, address, status == 0 ? data : NULL, size);
+}
+
+//------------------------------------------------------------------------------
+
+bool xlink_serve_save(uchar status) {
+  return serve_reply(status, 0, NULL, 0);
+}
+
+//------------------------------------------------------------------------------
+
+bool xlink_session_begin(bool blank, uint timeout) {
+
+  bool result = false;
+
+  if(!server_supports(XLINK_CAPABILITY_SESSION)) {
+    SET_ERROR(XLINK_ERROR_SERVER, "server does not support sessions");
+    goto done;
+  }
+  
+  if(driver->open()) {
+
+    if(!driver->ping()) {
+      SET_ERROR(XLINK_ERROR_SERVER, "no response from server");
+      goto error;
+    }
+
+    driver->output();
+    if(!driver->send((unsigned char []) {XLINK_COMMAND_SESSION,
+            blank ? 0x01 : 0x00, timeout > 0xff ? 0xff : timeout}, 3)) goto error;
+
+    driver->close();
+    result = true;
+  }
+
+ done:
+  CLEAR_ERROR_IF(result);
+  return result;
+
+ error:
+  driver->close();
+  goto done;
+}
+
+//------------------------------------------------------------------------------
+
+bool xlink_session_end(void) {
+
+  bool result = false;
+  
+  if(driver->open()) {
+
+    if(!driver->ping()) {
+      SET_ERROR(XLINK_ERROR_SERVER, "no response from server");
+      goto error;
+    }
+
+    driver->output();
+    if(!driver->send((unsigned char []) {XLINK_COMMAND_END}, 1)) goto error;
+
+    driver->close();
+    result = true;
+  }
+
+ done:
+  CLEAR_ERROR_IF(result);
+  return result;
+
+ error:
+  driver->close();
+  goto done;
+}
+
+//------------------------------------------------------------------------------
+
+void xlink_begin() {
+  driver->state = XLINK_DRIVER_STATE_IDLE;
+}
+
+//------------------------------------------------------------------------------
+
+bool xlink_send(uchar* data, uint size) {
+
+  bool result = false;
+
+  if(driver->open()) {
+
+    if(driver->state == XLINK_DRIVER_STATE_INPUT) {
+      driver->wait(0);
+    }
+    driver->output();
+    driver->state = XLINK_DRIVER_STATE_OUTPUT;
+
+    if(!driver->send(data, size)) goto error;
+
+    driver->close();
+    result = true;
+  }
+
+ done:  
+  CLEAR_ERROR_IF(result);
+  return result;
+
+ error:
+  driver->close();
+  goto done;
+}
+
+//------------------------------------------------------------------------------
+
+bool xlink_send_with_timeout(uchar* data, uint size, uint timeout) {
   bool result = false;
   
   driver->timeout = timeout;
@@ -687,25 +1860,169 @@ void xlink_end() {
 
 //------------------------------------------------------------------------------
 
-bool xlink_relocate(unsigned short address) {
+static bool relocate_remote(ushort address) {
 
   bool result = false;
+  uchar done;
+  
+  if(driver->open()) {
+    
+    if(!driver->ping()) {
+      SET_ERROR(XLINK_ERROR_SERVER, "no response from server");
+      goto error;
+    }
+
+    driver->output();    
+    if(!driver->send((unsigned char []) {XLINK_COMMAND_RELOCATE,
+            lo(address), hi(address)}, 3)) goto error;
+
+    // wait until the server has copied and patched itself
+    
+    driver->input();
+    driver->strobe();
+
+    if(!driver->receive(&done, 1)) goto error;
+
+    driver->close();
+    result = true;
+  }
+
+ done:
+  CLEAR_ERROR_IF(result);
+  return result;
+
+ error:
+  driver->close();
+  goto done;
+}
+
+//------------------------------------------------------------------------------
+
+static bool relocation_fits(uint start, uint end) {
+
+  // the server must neither wrap around nor cover I/O or ROM
   
+  uint areas[] = { machine->io, machine->lorom, machine->hirom };
+
+  if(end > 0x10000) {
+    SET_ERROR(XLINK_ERROR_SERVER, "cannot relocate server to $%04X-$%05X: "
+              "range exceeds the address space", start, end);
+    return false;
+  }
+  
+  for(int i=0; i<3; i++) {
+    uint lo = areas[i] >> 16;
+    uint hi = areas[i] & 0xffff;
+
+    if(hi == 0) hi = 0x10000;
+    
+    if(start < hi && end > lo) {
+      SET_ERROR(XLINK_ERROR_SERVER, "cannot relocate server to $%04X-$%04X: "
+                "range occupies $%04X-$%04X", start, end, lo, hi);
+      return false;
+    }
+  }
+  return true;
+}
+
+//------------------------------------------------------------------------------
+
+bool xlink_relocate(unsigned short address) {
+
+  bool result = false;
+  xlink_server_info_t running;
+  unsigned char* server = NULL;
   int size;
-  unsigned char* server = machine->server(address, &size);  
+  
+  logger->suspend();
+  bool known = xlink_identify(&running);
+  logger->resume();
+
+  server_forget();
+
+  // a server with a relocation table only needs the new address,
+  // unless the new location overlaps the current one; its length
+  // already includes the table
+  
+  if(known && (running.capabilities & XLINK_CAPABILITY_RELOCATE)) {
+
+    if(!relocation_fits(address, address + running.length)) goto done;
+    
+    if(address >= running.end || address + running.length <= running.start) {
+      return relocate_remote(address);
+    }
+  }
+  
+  if((server = machine->server(address, &size)) == NULL) {
+    SET_ERROR(XLINK_ERROR_SERVER, "no server available for the %s", machine->name);
+    goto done;
+  }
+
+  if(!relocation_fits(address, address + size-2)) goto done;
 
+  // a fresh copy starts without the disk vectors of the running server,
+  // so hand them back to the system instead of leaving them in the old one
+  
+  if(known && (running.capabilities & XLINK_CAPABILITY_DISK)) {
+    xlink_request_t request;
+
+    if(!xlink_serve_poll(0, &request)) goto done;
+    free(request.data);
+  }
+  
   uchar memory = machine->memory | 0x80;
   uchar bank = machine->bank;
   
-  if(!(result = xlink_load(memory, bank, address, server+2, size-2))) goto done;
+  if(!(result = load_auto(memory, bank, address, server+2, size-2))) goto done;
 
   result = xlink_jump(memory, bank, address);
-  
-  free(server);
 
  done:
+  free(server);
   CLEAR_ERROR_IF(result);
   return result;  
 }
 
 //------------------------------------------------------------------------------
+
+bool xlink_stub(void) {
+
+  bool result = false;
+  uchar* stub = NULL;
+  int size;
+
+  if(machine->stub == NULL) {
+    SET_ERROR(XLINK_ERROR_SERVER, "no resident stub available for the %s", machine->name);
+    goto done;
+  }
+
+  stub = machine->stub(&size);
+
+  ushort address = stub[0] | stub[1] << 8;
+  ushort end = address + size - 2;
+  ushort vectors = machine->vectors >> 16;
+  ushort above = machine->vectors & 0xffff;
+
+  // the stub surrounds the system vectors, which must be left intact
+
+  if(!load_auto(machine->memory, machine->bank, address,
+                stub+2, vectors - address)) goto done;
+
+  if(!load_auto(machine->memory, machine->bank, above,
+                stub+2 + (above - address), end - above)) goto done;
+
+  // the stub's irq handler starts right above the vectors; the server
+  // loads the irq vector from within its own irq, so the stub takes over
+  // with the next interrupt
+
+  result = load_auto(machine->memory, machine->bank, XLINK_IRQ_VECTOR,
+                     (uchar []) { lo(above), hi(above) }, 2);
+
+ done:
+  server_forget();
+  free(stub);
+  CLEAR_ERROR_IF(result);
+  return result;
+}
+
+//------------------------------------------------------------------------------
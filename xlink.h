@@ -19,6 +19,38 @@
 #define XLINK_MACHINE_C64      0x00
 #define XLINK_MACHINE_C128     0x01
 
+#define XLINK_PROTOCOL_VERSION 0x02
+
+#define XLINK_CAPABILITY_HUNT     0x0001
+#define XLINK_CAPABILITY_COMPARE  0x0002
+#define XLINK_CAPABILITY_SESSION  0x0004
+#define XLINK_CAPABILITY_LOADZ    0x0008
+#define XLINK_CAPABILITY_REU      0x0010
+#define XLINK_CAPABILITY_FILL     0x0020
+#define XLINK_CAPABILITY_FAST     0x0040 // C128 runs at 2MHz while the screen is blanked
+#define XLINK_CAPABILITY_LINEAR   0x0080
+#define XLINK_CAPABILITY_VDC      0x0100
+#define XLINK_CAPABILITY_OVERLAY  0x0200 // resident stub, other commands run as overlays
+#define XLINK_CAPABILITY_RELOCATE 0x0400 // server relocates itself using its relocation table
+#define XLINK_CAPABILITY_EXTENSION 0x0800 // server dispatches commands to uploaded handlers
+#define XLINK_CAPABILITY_DISK     0x1000 // LOAD/SAVE of a device can be served by the host
+
+#define XLINK_EXTENSIONS       8
+
+#define XLINK_BANK_REU         0x80 // bank selector for REU, memory holds the REU bank
+#define XLINK_BANK_LINEAR      0x40 // C128 RAM banks, memory holds first | last bank << 4
+#define XLINK_BANK_VDC         0x20 // C128 VDC (80 column) RAM, memory is ignored
+
+#define XLINK_SERVE_NONE       0x00
+#define XLINK_SERVE_LOAD       0x01
+#define XLINK_SERVE_SAVE       0x02
+
+#define XLINK_STATS_BUCKETS    6 // ACK waits < 16us, 128us, 1ms, 8ms, 65ms and longer
+
+#define XLINK_COMPRESSION_NONE   0x00
+#define XLINK_COMPRESSION_ALWAYS 0x01
+#define XLINK_COMPRESSION_AUTO   0x02
+
 #define XLINK_SUCCESS          0x00
 #define XLINK_ERROR_DEVICE     0x01
 #define XLINK_ERROR_LIBUSB     0x02
@@ -26,6 +58,7 @@
 #define XLINK_ERROR_SERVER     0x04
 #define XLINK_ERROR_FILE       0x05
 #define XLINK_ERROR_SERIAL     0x06
+#define XLINK_ERROR_DISCONNECTED 0x07 // the USB adapter was unplugged during the request
 
 #define XLINK_COMMAND_LOAD     0x01
 #define XLINK_COMMAND_SAVE     0x02
@@ -34,6 +67,16 @@
 #define XLINK_COMMAND_JUMP     0x05
 #define XLINK_COMMAND_RUN      0x06
 #define XLINK_COMMAND_INJECT   0x07
+#define XLINK_COMMAND_HUNT     0x08
+#define XLINK_COMMAND_COMPARE  0x09
+#define XLINK_COMMAND_SESSION  0x0a
+#define XLINK_COMMAND_END      0x0b
+#define XLINK_COMMAND_LOADZ    0x0c
+#define XLINK_COMMAND_FILL     0x0d
+#define XLINK_COMMAND_RELOCATE 0x0e
+#define XLINK_COMMAND_REGISTER 0x0f
+#define XLINK_COMMAND_EXTENSION 0x10 // first of XLINK_EXTENSIONS extension commands
+#define XLINK_COMMAND_SERVE    0xfc
 #define XLINK_COMMAND_PING     0xfd
 #define XLINK_COMMAND_IDENTIFY 0xfe
 
@@ -54,8 +97,39 @@ extern "C" {
     ushort end;     // server end address
     ushort length;  // server code length
     ushort memtop;  // current top of (lower) memory (0xa000 or 0x8000)
+    ushort capabilities; // XLINK_CAPABILITY_* supported by the server
+    uchar protocol; // highest protocol version supported by the server
   } xlink_server_info_t;
 
+  typedef struct {
+    uchar type;      // XLINK_SERVE_{NONE|LOAD|SAVE}
+    uchar device;    // device number used by the program
+    uchar secondary; // secondary address, LOAD uses start only if 0
+    ushort start;    // LOAD: address for secondary address 0, SAVE: start
+    ushort end;      // SAVE: end address (exclusive)
+    uchar length;    // length of the file name
+    uchar name[256]; // PETSCII file name, zero terminated
+    uchar* data;     // SAVE: the end-start bytes sent by the program
+  } xlink_request_t;
+
+  typedef struct {
+    char path[256];   // device path as accepted by xlink_set_device
+    char type[8];     // "usb", "serial", "parport" or "shm"
+    char serial[64];  // USB serial number, empty if unknown
+    int bus;          // USB bus number, -1 if unknown
+    int address;      // USB device address, -1 if unknown
+    ushort firmware;  // USB firmware release (bcd), 0 if unknown
+  } xlink_device_t;
+
+  typedef struct {
+    uint sent;       // bytes sent to the remote machine
+    uint received;   // bytes received from the remote machine
+    uint packets;    // USB data packets moved
+    ushort timeouts; // handshakes that timed out
+    ushort resets;   // adapter watchdog resets since power-on
+    uint waits[XLINK_STATS_BUCKETS]; // handshakes by time waited for ACK
+  } xlink_stats_t;
+
   typedef struct {
     int code;
     char message[512];
@@ -72,12 +146,22 @@ extern "C" {
   bool xlink_set_device(char* path);
   char* xlink_get_device(void);
 
+  /* list the transfer devices present, at most max */
+
+  bool xlink_devices(xlink_device_t* devices, int max, int* count);
+
   bool xlink_ping(void);
   bool xlink_reset(void);
   bool xlink_ready(void);
   bool xlink_identify(xlink_server_info_t* server);
   bool xlink_relocate(ushort address);
 
+  /* replace the running server with a minimal resident stub, commands
+     the stub lacks are served by the full server loaded as a transient
+     overlay, which is removed again afterwards */
+
+  bool xlink_stub(void);
+
   bool xlink_load(uchar memory, uchar bank, ushort address, uchar* data, uint size);  
   bool xlink_save(uchar memory, uchar bank, ushort address, uchar* data, uint size);
   bool xlink_peek(uchar memory, uchar bank, ushort address, uchar* value);
@@ -86,6 +170,74 @@ extern "C" {
   bool xlink_jump(uchar memory, uchar bank, ushort address);
   bool xlink_run(void);
 
+  /* transfer to/from a RAM expansion unit using 24 bit addresses */
+
+  bool xlink_reu_load(uint address, uchar* data, uint size);
+  bool xlink_reu_save(uint address, uchar* data, uint size);
+  bool xlink_reu_fill(uint address, uchar value, uint size);
+
+  /* transfer to/from C128 RAM using 17 bit addresses, crossing from
+     bank 0 into bank 1 within a single command */
+
+  bool xlink_load_linear(uint address, uchar* data, uint size);
+  bool xlink_save_linear(uint address, uchar* data, uint size);
+
+  /* transfer to/from the 64k of C128 VDC RAM, streamed through the
+     VDC's auto-incrementing update address */
+
+  bool xlink_vdc_load(uint address, uchar* data, uint size);
+  bool xlink_vdc_save(uint address, uchar* data, uint size);
+  bool xlink_vdc_fill(uint address, uchar value, uint size);
+
+  /* upload code to address and have the server call it for the given
+     extension command, with the command in y; the handler talks to the
+     host itself and returns with rts. Address 0 removes the handler */
+
+  bool xlink_register_handler(uchar command, ushort address, uchar* code, uint size);
+
+  /* serve LOAD and SAVE for a device from the host: poll announces the
+     device (0 ends serving) and returns a pending request, which has to
+     be answered by xlink_serve_load or xlink_serve_save. A status other
+     than 0 is returned to the program as kernal error code */
+
+  bool xlink_serve_poll(uchar device, xlink_request_t* request);
+  bool xlink_serve_load(uchar status, ushort address, uchar* data, uint size);
+  bool xlink_serve_save(uchar status);
+
+  /* compress data sent by xlink_load, either always or only if the
+     estimated decoding time beats the transfer time saved (default: none) */
+
+  void xlink_set_compression(uchar mode);
+
+  /* search size bytes at address for pattern (bits cleared in the
+     optional mask are ignored), store at most max matches */
+  
+  bool xlink_hunt(uchar memory, uchar bank, ushort address, uint size,
+                  uchar* pattern, uchar* mask, uint length,
+                  ushort* matches, uint max, uint* count);
+
+  /* compare data with the remote memory at address, count holds the
+     number of mismatches of which the first max are stored */
+  
+  bool xlink_compare(uchar memory, uchar bank, ushort address, uchar* data, uint size,
+                     ushort* mismatches, uint max, uint* count);
+
+  /* keep the server in a command loop with interrupts disabled until
+     the session is ended or no command arrived for timeout seconds */
+  
+  bool xlink_session_begin(bool blank, uint timeout);
+  bool xlink_session_end(void);
+  
+  /* have the adapter simulate the peer (ack every strobe, drop bytes
+     sent, receive a counter) to measure the host and USB path alone.
+     The "sim" device is a software adapter that always behaves so */
+
+  bool xlink_loopback(bool enabled);
+
+  /* read the counters kept by the adapter, optionally clearing them */
+
+  bool xlink_stats(xlink_stats_t* stats, bool clear);
+
   /* low level interface */
   
   bool xlink_inject(ushort address, uchar* code, uint size);